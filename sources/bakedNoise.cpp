@@ -0,0 +1,183 @@
+#include <cmath>
+#include <vector>
+
+#include "bakedNoise.h"
+#include "fractalNoise.h"
+
+#include <cage-core/config.h>
+#include <cage-core/random.h>
+#include <cage-core/string.h>
+
+namespace unnatural
+{
+	namespace
+	{
+		const ConfigFloat configBakeFrequency("unnatural-planets/noise/bakeFrequency");
+
+		constexpr Real Extent = 2100; // covers the meshing box with some margin
+		constexpr Real SamplesPerWavelength = 8;
+		constexpr uint32 MaxResolution = 128;
+		constexpr uint32 ReportSamples = 10000;
+
+		Real highestFrequency(const NoiseFunctionCreateConfig &cfg)
+		{
+			if (cfg.fractalType == NoiseFractalTypeEnum::None || cfg.octaves <= 1)
+				return cfg.frequency;
+			return cfg.frequency * pow(cfg.lacunarity, Real(cfg.octaves - 1));
+		}
+
+		// the tricubic interpolation smears discontinuities and creases and overshoots around them
+		bool smooth(const NoiseFunctionCreateConfig &cfg)
+		{
+			if (cfg.type == NoiseTypeEnum::Cellular || cfg.operation == NoiseOperationEnum::Cell)
+				return false;
+			if (cfg.fractalType == NoiseFractalTypeEnum::Ridged || cfg.fractalType == NoiseFractalTypeEnum::PingPong)
+				return false;
+			return true;
+		}
+
+		// catmull-rom weights
+		void cubicWeights(float t, float w[4])
+		{
+			const float t2 = t * t;
+			const float t3 = t2 * t;
+			w[0] = 0.5f * (-t3 + 2 * t2 - t);
+			w[1] = 0.5f * (3 * t3 - 5 * t2 + 2);
+			w[2] = 0.5f * (-3 * t3 + 4 * t2 + t);
+			w[3] = 0.5f * (t3 - t2);
+		}
+	}
+
+	class BakedNoiseImpl : public BakedNoise
+	{
+	public:
+		const Holder<FractalNoise> noise;
+		std::vector<float> lattice; // empty if not baked
+		Real origin; // position of the lattice point 0 along each axis
+		Real invSpacing;
+		uint32 resolution = 0;
+
+		BakedNoiseImpl(const NoiseFunctionCreateConfig &cfg, const String &name) : noise(newFractalNoise(cfg))
+		{
+			const Real freq = highestFrequency(cfg);
+			if (!(freq < (float)configBakeFrequency))
+				return;
+			if (!smooth(cfg))
+			{
+				CAGE_LOG(SeverityEnum::Info, "bakedNoise", Stringizer() + "not baking non-smooth noise: " + name);
+				return;
+			}
+
+			// one extra point on the low side and two on the high side are required by the cubic stencil
+			const uint32 cells = numeric_cast<uint32>(ceil(Extent * 2 * freq * SamplesPerWavelength));
+			if (cells > MaxResolution - 3)
+			{
+				CAGE_LOG(SeverityEnum::Info, "bakedNoise", Stringizer() + "not baking noise: " + name + ", frequency: " + freq + ", the lattice would exceed the resolution limit");
+				return;
+			}
+			const Real spacing = Extent * 2 / cells;
+			resolution = cells + 3;
+			origin = -Extent - spacing;
+			invSpacing = 1 / spacing;
+
+			lattice.resize(resolution * resolution * resolution);
+			std::vector<Vec3> positions;
+			std::vector<Real> values;
+			positions.resize(resolution * resolution);
+			values.resize(resolution * resolution);
+			for (uint32 z = 0; z < resolution; z++)
+			{
+				for (uint32 y = 0; y < resolution; y++)
+					for (uint32 x = 0; x < resolution; x++)
+						positions[y * resolution + x] = Vec3(x, y, z) * spacing + origin;
+				noise->evaluate(positions, values, 0); // full detail
+				float *dst = lattice.data() + z * resolution * resolution;
+				for (const Real v : values)
+					*dst++ = v.value;
+			}
+
+			{ // error report
+				RandomGenerator rng(hash(cfg.seed), 0x6b61d5c9);
+				Real maxError = 0;
+				Real sumSquares = 0;
+				for (uint32 i = 0; i < ReportSamples; i++)
+				{
+					const Vec3 p = rng.randomRange3(-Extent, Extent);
+					const Real e = abs(evaluate(p) - noise->evaluate(p, 0));
+					maxError = max(maxError, e);
+					sumSquares += e * e;
+				}
+				CAGE_LOG(SeverityEnum::Info, "bakedNoise", Stringizer() + "baked noise: " + name + ", frequency: " + freq + ", resolution: " + resolution + ", max error: " + maxError + ", rms error: " + sqrt(sumSquares / ReportSamples));
+			}
+		}
+
+		// returns false if the position is outside the lattice
+		bool lookup(const Vec3 &position, Real &result) const
+		{
+			float f[3];
+			sint32 c[3];
+			for (uint32 a = 0; a < 3; a++)
+			{
+				const float g = ((position[a] - origin) * invSpacing).value;
+				if (!(g >= 1 && g < resolution - 2))
+					return false;
+				c[a] = (sint32)g;
+				f[a] = g - c[a];
+			}
+			float wx[4], wy[4], wz[4];
+			cubicWeights(f[0], wx);
+			cubicWeights(f[1], wy);
+			cubicWeights(f[2], wz);
+			const uint32 r = resolution;
+			const float *base = lattice.data() + ((c[2] - 1) * r + (c[1] - 1)) * r + (c[0] - 1);
+			float sum = 0;
+			for (uint32 z = 0; z < 4; z++)
+			{
+				float sz = 0;
+				for (uint32 y = 0; y < 4; y++)
+				{
+					const float *row = base + (z * r + y) * r;
+					sz += wy[y] * (wx[0] * row[0] + wx[1] * row[1] + wx[2] * row[2] + wx[3] * row[3]);
+				}
+				sum += wz[z] * sz;
+			}
+			result = sum;
+			return true;
+		}
+
+		Real evaluate(const Vec3 &position) const
+		{
+			Real result;
+			if (!lattice.empty() && lookup(position, result))
+				return result;
+			return noise->evaluate(position);
+		}
+
+		void evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results) const
+		{
+			CAGE_ASSERT(positions.size() == results.size());
+			if (lattice.empty())
+				return noise->evaluate(positions, results);
+			for (uint32 i = 0; i < positions.size(); i++)
+				if (!lookup(positions[i], results[i]))
+					results[i] = noise->evaluate(positions[i]);
+		}
+	};
+
+	Real BakedNoise::evaluate(const Vec3 &position) const
+	{
+		const BakedNoiseImpl *impl = (const BakedNoiseImpl *)this;
+		return impl->evaluate(position);
+	}
+
+	void BakedNoise::evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results) const
+	{
+		const BakedNoiseImpl *impl = (const BakedNoiseImpl *)this;
+		impl->evaluate(positions, results);
+	}
+
+	Holder<BakedNoise> newBakedNoise(const NoiseFunctionCreateConfig &cfg, const String &name)
+	{
+		return systemMemory().createImpl<BakedNoise, BakedNoiseImpl>(cfg, name);
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef bakedNoise_h_k3v9x2mq
+#define bakedNoise_h_k3v9x2mq
+
+#include "planets.h"
+
+#include <cage-core/noiseFunction.h>
+
+namespace unnatural
+{
+	// noise function that is sampled once into a lattice covering the whole planet and served by tricubic interpolation
+	// only smooth noises whose highest frequency is below the configured threshold, and whose lattice fits the resolution limit, are baked
+	// others are evaluated as fractal noises at the current sampling footprint
+	class BakedNoise : private Immovable
+	{
+	public:
+		Real evaluate(const Vec3 &position) const;
+		void evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results) const;
+	};
+
+	// the name is used for logging the baking error report
+	Holder<BakedNoise> newBakedNoise(const NoiseFunctionCreateConfig &cfg, const String &name);
+}
+
+#endif
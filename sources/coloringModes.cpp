@@ -1,4 +1,9 @@
-#include "math.h"
+#include <atomic>
+
+#include "bakedNoise.h"
+#include "fastMath.h"
+#include "fractalNoise.h"
+#include "noiseBundle.h"
 #include "planets.h"
 #include "voronoi.h"
 
@@ -12,12 +17,62 @@ namespace unnatural
 {
 	Real terrainSdfElevation(const Vec3 &pos);
 	Real terrainSdfElevationRaw(const Vec3 &pos);
+	Vec3 terrainSdfElevationGradient(const Vec3 &pos);
 
 	namespace
 	{
 		const ConfigBool configPolesEnable("unnatural-planets/poles/enable");
 		const ConfigBool configFlowersEnable("unnatural-planets/flowers/enable");
 
+		enum class LayerEnum : uint32
+		{
+			Cliffs,
+			Mica,
+			Dirt,
+			Sand,
+			Grass,
+			Boulders,
+			Flowers,
+			Ice,
+			Snow,
+			_Total
+		};
+
+		constexpr const char *const layerNames[] = {
+			"cliffs",
+			"mica",
+			"dirt",
+			"sand",
+			"grass",
+			"boulders",
+			"flowers",
+			"ice",
+			"snow",
+		};
+
+		static_assert((uint32)LayerEnum::_Total == sizeof(layerNames) / sizeof(layerNames[0]), "number of layers and names must match");
+
+		std::atomic<uint64> layerEvaluations[(uint32)LayerEnum::_Total];
+		std::atomic<uint64> layerSkips[(uint32)LayerEnum::_Total];
+
+		// counts evaluations of a layer and how many of them did not contribute
+		// the counts are updated on every evaluation, which is cheap compared to the noises of the layer, and they are complete whenever they are logged
+		struct LayerCounter
+		{
+			const LayerEnum layer;
+			bool contributed = false;
+
+			explicit LayerCounter(LayerEnum layer) : layer(layer) {}
+
+			~LayerCounter()
+			{
+				const uint32 i = (uint32)layer;
+				layerEvaluations[i].fetch_add(1, std::memory_order_relaxed);
+				if (!contributed)
+					layerSkips[i].fetch_add(1, std::memory_order_relaxed);
+			}
+		};
+
 		// returns zero when the slope is at or above the threshold plus the smoothing,
 		// returns one when the slope is at or below the threshold minus the smoothing
 		Real steepnessMask(Degs slope, Degs threshold, Degs smoothing)
@@ -58,7 +113,7 @@ namespace unnatural
 
 		void generatePrecipitation(Tile &tile)
 		{
-			static const Holder<NoiseFunction> precpNoise = []()
+			static const Holder<BakedNoise> precpNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cubic;
@@ -66,8 +121,10 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.001;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newBakedNoise(cfg, "precipitation");
 			}();
+			if (valid(tile.precipitation))
+				return; // already provided
 			Real p = precpNoise->evaluate(tile.position) * 0.5 + 0.5;
 			p = saturate(p);
 			p = smootherstep(p);
@@ -81,7 +138,7 @@ namespace unnatural
 
 		void generateTemperature(Tile &tile)
 		{
-			static const Holder<NoiseFunction> tempNoise = []()
+			static const Holder<BakedNoise> tempNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Simplex;
@@ -90,9 +147,9 @@ namespace unnatural
 				cfg.gain = 0.4;
 				cfg.frequency = 0.0003;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newBakedNoise(cfg, "temperature");
 			}();
-			static const Holder<NoiseFunction> polarNoise = []()
+			static const Holder<FractalNoise> polarNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Value;
@@ -100,9 +157,11 @@ namespace unnatural
 				cfg.octaves = 3;
 				cfg.frequency = 0.007;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 
+			if (valid(tile.temperature))
+				return; // already provided
 			Real t = tempNoise->evaluate(tile.position) * 0.5 + 0.5;
 			t = saturate(t);
 			t = smoothstep(t);
@@ -110,8 +169,8 @@ namespace unnatural
 
 			if (configPolesEnable)
 			{
-				Real polar = abs(atan(tile.position[1] / length(Vec2(tile.position[0], tile.position[2]))).value) / Real::Pi() * 2;
-				polar = pow(polar, 1.7);
+				Real polar = abs(fastAtan(tile.position[1] / length(Vec2(tile.position[0], tile.position[2]))).value) / Real::Pi() * 2;
+				polar = fastPow(polar, 1.7);
 				polar += polarNoise->evaluate(tile.position) * 0.1;
 				t += 0.6 - polar * 3.2;
 			}
@@ -121,33 +180,11 @@ namespace unnatural
 
 		void generateSlope(Tile &tile)
 		{
-			static constexpr Real radius = 0.5;
-			Vec3 a = anyPerpendicular(tile.normal);
-			Vec3 b = cross(tile.normal, a);
-			a *= radius;
-			b *= radius;
-			const Real div = 1 / sqrt(2);
-			Vec3 c = (a + b) * div;
-			Vec3 d = (a - b) * div;
-			Real elevs[8] = {
-				terrainSdfElevation(tile.position + a),
-				terrainSdfElevation(tile.position + b),
-				terrainSdfElevation(tile.position - a),
-				terrainSdfElevation(tile.position - b),
-				terrainSdfElevation(tile.position + c),
-				terrainSdfElevation(tile.position + d),
-				terrainSdfElevation(tile.position - c),
-				terrainSdfElevation(tile.position - d),
-			};
-			Real e1 = elevs[0];
-			Real e2 = elevs[0];
-			for (Real e : elevs)
-			{
-				e1 = min(e1, e);
-				e2 = max(e2, e);
-			}
-			Real md = (e2 - e1) * 0.1;
-			tile.slope = atan(md / radius);
+			// tangential component of the elevation gradient
+			// equivalent to the spread of the elevation sampled on a small circle around the tile
+			const Vec3 g = terrainSdfElevationGradient(tile.position);
+			const Vec3 t = g - tile.normal * dot(g, tile.normal);
+			tile.slope = atan(length(t) * 0.2);
 		}
 
 		void generateBiome(Tile &tile)
@@ -199,46 +236,26 @@ namespace unnatural
 				tile.type = TerrainTypeEnum::Flat;
 		}
 
-		void generateBedrock(Tile &tile)
+		void generateBedrock(PointerRange<Tile> tiles)
 		{
 			static const uint32 seed = noiseSeed();
-			static const Holder<NoiseFunction> depthNoise = []()
+			static const Holder<BakedNoise> depthNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cubic;
 				cfg.frequency = 0.0031;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newBakedNoise(cfg, "bedrock depth");
 			}();
-			static const Holder<NoiseFunction> freqNoise = []()
+			static const Holder<BakedNoise> freqNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cubic;
 				cfg.frequency = 0.013;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
-			}();
-			static const Holder<NoiseFunction> cracksNoise = []()
-			{
-				NoiseFunctionCreateConfig cfg;
-				cfg.type = NoiseTypeEnum::Cellular;
-				cfg.distance = NoiseDistanceEnum::Hybrid;
-				cfg.operation = NoiseOperationEnum::Subtract;
-				cfg.frequency = 0.017;
-				cfg.seed = seed;
-				return newNoiseFunction(cfg);
+				return newBakedNoise(cfg, "bedrock frequency");
 			}();
-			static const Holder<NoiseFunction> valueNoise = []()
-			{
-				NoiseFunctionCreateConfig cfg;
-				cfg.type = NoiseTypeEnum::Cellular;
-				cfg.distance = NoiseDistanceEnum::Hybrid;
-				cfg.operation = NoiseOperationEnum::Cell;
-				cfg.frequency = 0.017;
-				cfg.seed = seed;
-				return newNoiseFunction(cfg);
-			}();
-			static const Holder<NoiseFunction> saturationNoise = []()
+			static const Holder<BakedNoise> saturationNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cubic;
@@ -246,23 +263,59 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.0022;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newBakedNoise(cfg, "bedrock saturation");
+			}();
+			// the cracks and the cell values share the positions scaled by the frequency noise
+			static const Holder<NoiseBundle> cellNoises = []()
+			{
+				NoiseFunctionCreateConfig cfgs[2];
+				for (NoiseFunctionCreateConfig &cfg : cfgs)
+				{
+					cfg.type = NoiseTypeEnum::Cellular;
+					cfg.distance = NoiseDistanceEnum::Hybrid;
+					cfg.frequency = 0.017;
+					cfg.seed = seed;
+				}
+				cfgs[0].operation = NoiseOperationEnum::Subtract; // cracks
+				cfgs[1].operation = NoiseOperationEnum::Cell; // value
+				return newNoiseBundle(cfgs);
 			}();
 
-			const Real depth = sqr(depthNoise->evaluate(tile.position) * 0.5 + 0.501) * 2;
-			const Real freq = freqNoise->evaluate(tile.position) * 0.15 + 1;
-			const Real cracks = saturate(pow(cracksNoise->evaluate(tile.position * freq) * 0.5 + 0.5, 0.7)); // zero inside scratches, one on the flat
-			const Real value = valueNoise->evaluate(tile.position * freq);
-			const Real saturation = saturate(saturationNoise->evaluate(tile.position) * 0.35 + 0.3);
-			const Vec3 hsv = Vec3(0.07, saturation, saturate(value * 0.1 + 0.7) * (cracks * 0.4 + 0.6));
-			tile.albedo = colorHsvToRgb(hsv);
-			tile.roughness = interpolate(0.9, value * -0.15 + 0.65, cracks);
-			tile.height = cracks * depth;
+			static constexpr uint32 BatchSize = 64;
+			Vec3 positions[BatchSize];
+			Real depths[BatchSize], freqs[BatchSize], saturations[BatchSize], cells[BatchSize * 2];
+			for (uint32 offset = 0; offset < tiles.size(); offset += BatchSize)
+			{
+				const uint32 n = min(BatchSize, numeric_cast<uint32>(tiles.size()) - offset);
+				Tile *const ts = tiles.data() + offset;
+				for (uint32 i = 0; i < n; i++)
+					positions[i] = ts[i].position;
+				const PointerRange<const Vec3> ps = { positions, positions + n };
+				depthNoise->evaluate(ps, { depths, depths + n });
+				freqNoise->evaluate(ps, { freqs, freqs + n });
+				saturationNoise->evaluate(ps, { saturations, saturations + n });
+				for (uint32 i = 0; i < n; i++)
+					freqs[i] = freqs[i] * 0.15 + 1; // the cells are evaluated at varying frequency
+				cellNoises->evaluate(ps, { freqs, freqs + n }, { cells, cells + n * 2 });
+
+				for (uint32 i = 0; i < n; i++)
+				{
+					Tile &tile = ts[i];
+					const Real depth = sqr(depths[i] * 0.5 + 0.501) * 2;
+					const Real crack = saturate(pow(cells[i] * 0.5 + 0.5, 0.7)); // zero inside scratches, one on the flat
+					const Real value = cells[n + i];
+					const Real saturation = saturate(saturations[i] * 0.35 + 0.3);
+					const Vec3 hsv = Vec3(0.07, saturation, saturate(value * 0.1 + 0.7) * (crack * 0.4 + 0.6));
+					tile.albedo = colorHsvToRgb(hsv);
+					tile.roughness = interpolate(0.9, value * -0.15 + 0.65, crack);
+					tile.height = crack * depth;
+				}
+			}
 		}
 
 		void generateCliffs(Tile &tile)
 		{
-			static const Holder<NoiseFunction> cracksNoise = []()
+			static const Holder<FractalNoise> cracksNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::SimplexReduced;
@@ -270,12 +323,14 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.047;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 
+			LayerCounter counter(LayerEnum::Cliffs);
 			const Real bf = steepnessMask(tile.slope, Degs(19), Degs(4));
 			if (bf > 0.99999)
 				return;
+			counter.contributed = true;
 
 			Vec3 hsv = colorRgbToHsv(tile.albedo);
 			hsv[0] = interpolate(155.0 / 255.0, hsv[0], sharpEdge(bf, 0.005));
@@ -319,9 +374,11 @@ namespace unnatural
 			if (!configFlowersEnable)
 				return;
 
+			LayerCounter counter(LayerEnum::Mica);
 			const Real bf = saturate((maskNoise->evaluate(tile.position) - 0.98) * 10);
 			if (bf < 1e-7)
 				return;
+			counter.contributed = true;
 
 			const Real cracks = sharpEdge(saturate((cracksNoise->evaluate(tile.position) + 0.6)));
 			const Vec3 color = interpolate(Vec3(122, 90, 88) / 255, Vec3(184, 209, 187) / 255, cracks);
@@ -337,7 +394,7 @@ namespace unnatural
 
 		void generateDirt(Tile &tile)
 		{
-			static const Holder<NoiseFunction> heightNoise = []()
+			static const Holder<FractalNoise> heightNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Perlin;
@@ -347,9 +404,9 @@ namespace unnatural
 				cfg.gain = 0.4;
 				cfg.frequency = 0.05;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
-			static const Holder<NoiseFunction> cracksNoise = []()
+			static const Holder<FractalNoise> cracksNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::SimplexReduced;
@@ -357,9 +414,9 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.07;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
-			static const Holder<NoiseFunction> cracksMaskNoise = []()
+			static const Holder<FractalNoise> cracksMaskNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cubic;
@@ -367,13 +424,19 @@ namespace unnatural
 				cfg.octaves = 4;
 				cfg.frequency = 0.02;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 
+			LayerCounter counter(LayerEnum::Dirt);
+			const Real steepness = steepnessMask(tile.slope, Degs(20), Degs(5));
+			if (steepness < 1e-7)
+				return;
+
 			Real height = heightNoise->evaluate(tile.position) * 0.2 + 0.5;
-			Real bf = sharpEdge(saturate(height - tile.height + 0.4)) * steepnessMask(tile.slope, Degs(20), Degs(5));
+			Real bf = sharpEdge(saturate(height - tile.height + 0.4)) * steepness;
 			if (bf < 1e-7)
 				return;
+			counter.contributed = true;
 
 			Vec3 color = Vec3(168, 94, 28) / 255;
 			{
@@ -403,7 +466,7 @@ namespace unnatural
 
 		void generateSand(Tile &tile)
 		{
-			static const Holder<NoiseFunction> heightScaleNoise = []()
+			static const Holder<FractalNoise> heightScaleNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Simplex;
@@ -411,9 +474,9 @@ namespace unnatural
 				cfg.octaves = 3;
 				cfg.frequency = 0.001;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
-			static const Holder<NoiseFunction> heightNoise = []()
+			static const Holder<FractalNoise> heightNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Simplex;
@@ -422,7 +485,7 @@ namespace unnatural
 				cfg.gain = 0.7;
 				cfg.frequency = 0.01;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 			static const Holder<NoiseFunction> colorNoise = []()
 			{
@@ -432,7 +495,7 @@ namespace unnatural
 				cfg.seed = noiseSeed();
 				return newNoiseFunction(cfg);
 			}();
-			static const Holder<NoiseFunction> hueNoise = []()
+			static const Holder<FractalNoise> hueNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cubic;
@@ -440,15 +503,17 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.02;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 
+			LayerCounter counter(LayerEnum::Sand);
 			const Real bf = rangeMask(tile.temperature, 24, 28) * steepnessMask(tile.slope, Degs(19), Degs(10));
 			if (bf < 1e-7)
 				return;
+			counter.contributed = true;
 
 			const Real heightScale = heightScaleNoise->evaluate(tile.position) * 0.3 + 1;
-			const Real height = (heightNoise->evaluate(tile.position * heightScale) * 0.2) * (rangeMask(tile.precipitation, 100, 50) * 0.4 + 0.6) + 0.5;
+			const Real height = (heightNoise->evaluate(tile.position * heightScale, samplingFootprint() * heightScale) * 0.2) * (rangeMask(tile.precipitation, 100, 50) * 0.4 + 0.6) + 0.5;
 			const Real colorShift = smootherstep(smootherstep(colorNoise->evaluate(tile.position) * 0.5 + 0.5));
 			const Real hueShift = hueNoise->evaluate(tile.position) * 0.1;
 			Vec3 color = colorHueShift(Vec3(189, 174, 152) / 255, hueShift);
@@ -467,7 +532,7 @@ namespace unnatural
 		void generateGrass(Tile &tile)
 		{
 			static const uint32 seed = noiseSeed();
-			static const Holder<NoiseFunction> hueNoise = []()
+			static const Holder<FractalNoise> hueNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Perlin;
@@ -475,7 +540,7 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.01;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 			static const Holder<NoiseFunction> patchesCellsNoise = []()
 			{
@@ -508,9 +573,14 @@ namespace unnatural
 				return newNoiseFunction(cfg);
 			}();
 
-			Real bf = rangeMask(tile.temperature, 35, 25) * rangeMask(tile.precipitation, 15, 35) * steepnessMask(tile.slope, Degs(22), Degs(3)) * beachMask(tile);
+			LayerCounter counter(LayerEnum::Grass);
+			Real bf = rangeMask(tile.temperature, 35, 25) * rangeMask(tile.precipitation, 15, 35) * steepnessMask(tile.slope, Degs(22), Degs(3));
+			if (bf < 1e-7)
+				return;
+			bf *= beachMask(tile);
 			if (bf < 1e-7)
 				return;
+			counter.contributed = true;
 
 			const Real dryness = clamp(tile.temperature - (tile.precipitation + 100) * 30 / 400, 0, 5) / 5; // 0 .. 1
 			const Real hueShiftBase = hueNoise->evaluate(tile.position);
@@ -586,6 +656,7 @@ namespace unnatural
 			if (!configFlowersEnable)
 				return;
 
+			LayerCounter counter(LayerEnum::Boulders);
 			if (thresholdNoise->evaluate(tile.position) < 0.15)
 				return;
 
@@ -597,6 +668,7 @@ namespace unnatural
 			const Real bf = rangeMask(size - dist, 0, 0.5);
 			if (bf < 1e-7)
 				return;
+			counter.contributed = true;
 
 			const Real hueShift = hueNoise->evaluate(tile.position) * 0.12;
 			const Real valueShift = valueNoise->evaluate(tile.position) * 0.18;
@@ -616,7 +688,7 @@ namespace unnatural
 
 		void generateWater(Tile &tile)
 		{
-			static const Holder<NoiseFunction> colorSwitchNoise = []()
+			static const Holder<FractalNoise> colorSwitchNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Perlin;
@@ -624,9 +696,9 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.0015;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
-			static const Holder<NoiseFunction> hueShiftNoise = []()
+			static const Holder<FractalNoise> hueShiftNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cubic;
@@ -634,7 +706,7 @@ namespace unnatural
 				cfg.octaves = 3;
 				cfg.frequency = 0.004;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 
 			{
@@ -671,14 +743,7 @@ namespace unnatural
 				cfg.seed = noiseSeed();
 				return newVoronoi(cfg);
 			}();
-			static const Holder<NoiseFunction> sizeNoise = []()
-			{
-				NoiseFunctionCreateConfig cfg;
-				cfg.type = NoiseTypeEnum::Perlin;
-				cfg.frequency = 0.35;
-				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
-			}();
+			static const uint32 sizeSeed = noiseSeed();
 			static const Holder<NoiseFunction> colorNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
@@ -687,26 +752,24 @@ namespace unnatural
 				cfg.seed = noiseSeed();
 				return newNoiseFunction(cfg);
 			}();
-			static const Holder<NoiseFunction> hue1Noise = []()
-			{
-				NoiseFunctionCreateConfig cfg;
-				cfg.type = NoiseTypeEnum::Perlin;
-				cfg.frequency = 0.005;
-				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
-			}();
-			static const Holder<NoiseFunction> hue2Noise = []()
+			static const Holder<NoiseBundle> shapeNoises = []()
 			{
-				NoiseFunctionCreateConfig cfg;
-				cfg.type = NoiseTypeEnum::Perlin;
-				cfg.frequency = 0.4;
-				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				NoiseFunctionCreateConfig cfgs[3];
+				for (NoiseFunctionCreateConfig &cfg : cfgs)
+					cfg.type = NoiseTypeEnum::Perlin;
+				cfgs[0].frequency = 0.35; // size
+				cfgs[0].seed = sizeSeed;
+				cfgs[1].frequency = 0.005; // hue 1
+				cfgs[1].seed = noiseSeed();
+				cfgs[2].frequency = 0.4; // hue 2
+				cfgs[2].seed = noiseSeed();
+				return newNoiseBundle(cfgs);
 			}();
 
 			if (!configFlowersEnable)
 				return;
 
+			LayerCounter counter(LayerEnum::Flowers);
 			const bool waterlily = tile.meshPurpose != MeshPurposeEnum::Land;
 			if ((tile.biome == TerrainBiomeEnum::Water) != waterlily)
 				return;
@@ -723,15 +786,18 @@ namespace unnatural
 			const Vec3 cluster = clusterVoronoi->evaluate(tile.position, tile.normal).points[0];
 			if (distanceSquared(center, cluster) > sqr(20))
 				return;
+			Real shape[3];
+			shapeNoises->evaluate(tile.position, shape);
 			const Real dist = distance(center, tile.position);
-			const Real size = smootherstep(smootherstep(saturate(sizeNoise->evaluate(tile.position) * 0.5 + 0.5))) * 2 + 1.5;
+			const Real size = smootherstep(smootherstep(saturate(shape[0] * 0.5 + 0.5))) * 2 + 1.5;
 
 			const Real bf = rangeMask(size - dist, 0, 0.1);
 			if (bf < 1e-7)
 				return;
+			counter.contributed = true;
 
 			const Vec3 baseColor = waterlily ? Vec3(0.2, 0.14, 0) : interpolateColor(Vec3(0.5, 0, 0.35), Vec3(0.5, 0.4, 0), sharpEdge(colorNoise->evaluate(cluster) + 0.4, 0.2));
-			const Vec3 color = colorHueShift(baseColor, hue1Noise->evaluate(tile.position) * 0.1 + hue2Noise->evaluate(tile.position) * 0.1);
+			const Vec3 color = colorHueShift(baseColor, shape[1] * 0.1 + shape[2] * 0.1);
 			const Real roughness = 0.8;
 			const Real metallic = waterlily ? 0.85 : 0; // signal to apply dynamic waves in the shader
 			const Real height = 0.7 + sqr(dist / size) * 0.2;
@@ -743,9 +809,8 @@ namespace unnatural
 			tile.opacity = interpolate(tile.opacity, 1, bf);
 		}
 
-		void generateIce(Tile &tile)
+		Real iceMask(const Tile &tile)
 		{
-			static const uint32 seed = noiseSeed();
 			static const Holder<NoiseFunction> temperatureOffsetNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
@@ -754,7 +819,30 @@ namespace unnatural
 				cfg.seed = noiseSeed();
 				return newNoiseFunction(cfg);
 			}();
-			static const Holder<NoiseFunction> freqNoise = []()
+
+			// the temperature offset is within -1.5 .. 1.5
+			if (tile.temperature > 2)
+				return 0;
+
+			const Real tempOff = temperatureOffsetNoise->evaluate(tile.position) * 1.5;
+			return sharpEdge(rangeMask(tile.temperature + tempOff, 0, -3)) * (1 - beachMask(tile));
+		}
+
+		void generateIceType(Tile &tile, Real bf)
+		{
+			if (bf > 0.1)
+			{
+				if (tile.type != TerrainTypeEnum::Cliffs)
+					tile.type = TerrainTypeEnum::Rough;
+			}
+		}
+
+		void generateIce(Tile &tile)
+		{
+			static const uint32 seed = noiseSeed();
+			LayerCounter counter(LayerEnum::Ice);
+			const Real bf = iceMask(tile); // initializes its noise in the same order as before
+			static const Holder<FractalNoise> freqNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Value;
@@ -762,9 +850,9 @@ namespace unnatural
 				cfg.octaves = 3;
 				cfg.frequency = 0.01;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
-			static const Holder<NoiseFunction> thicknessNoise = []()
+			static const Holder<FractalNoise> thicknessNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cellular;
@@ -774,9 +862,9 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.05;
 				cfg.seed = seed;
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
-			static const Holder<NoiseFunction> cracksNoise = []()
+			static const Holder<FractalNoise> cracksNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cellular;
@@ -786,23 +874,18 @@ namespace unnatural
 				cfg.octaves = 2;
 				cfg.frequency = 0.05;
 				cfg.seed = seed;
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 
-			const Real tempOff = temperatureOffsetNoise->evaluate(tile.position) * 1.5;
-			const Real bf = sharpEdge(rangeMask(tile.temperature + tempOff, 0, -3)) * (1 - beachMask(tile));
 			if (bf < 1e-7)
 				return;
+			counter.contributed = true;
 
-			if (bf > 0.1)
-			{
-				if (tile.type != TerrainTypeEnum::Cliffs)
-					tile.type = TerrainTypeEnum::Rough;
-			}
+			generateIceType(tile, bf);
 
 			const Real freq = freqNoise->evaluate(tile.position) * 0.08 + 1;
-			const Real thickness = sharpEdge(saturate(thicknessNoise->evaluate(tile.position * freq) * 0.5 + 0.8), 0.1) * 0.6 + 0.4; // 0.4 .. 1
-			const Real crack = 1 - pow(cracksNoise->evaluate(tile.position * freq) * 0.5 + 0.5, 0.3);
+			const Real thickness = sharpEdge(saturate(thicknessNoise->evaluate(tile.position * freq, samplingFootprint() * freq) * 0.5 + 0.8), 0.1) * 0.6 + 0.4; // 0.4 .. 1
+			const Real crack = 1 - pow(cracksNoise->evaluate(tile.position * freq, samplingFootprint() * freq) * 0.5 + 0.5, 0.3);
 			Vec3 color = max(Vec3(122, 162, 164) / 255 - crack * 0.3, 0);
 			color = interpolateColor(tile.albedo, color, thickness);
 			Real roughness = 0.15 + crack * 0.6;
@@ -826,7 +909,7 @@ namespace unnatural
 				cfg.seed = noiseSeed();
 				return newNoiseFunction(cfg);
 			}();
-			static const Holder<NoiseFunction> thicknessNoise = []()
+			static const Holder<FractalNoise> thicknessNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Cubic;
@@ -834,14 +917,21 @@ namespace unnatural
 				cfg.octaves = 3;
 				cfg.frequency = 0.05;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 
-			Real bf = sharpEdge(rangeMask(tile.elevation + elevOffsetNoise->evaluate(tile.position) * 20, 220, 240) * steepnessMask(tile.slope, Degs(25), Degs(5)));
+			LayerCounter counter(LayerEnum::Snow);
+			const Real steepness = steepnessMask(tile.slope, Degs(25), Degs(5));
+			// the elevation offset is within -20 .. 20
+			if (sharpEdge(rangeMask(tile.elevation + 25, 220, 240) * steepness) < 1e-7)
+				return;
+
+			Real bf = sharpEdge(rangeMask(tile.elevation + elevOffsetNoise->evaluate(tile.position) * 20, 220, 240) * steepness);
 			const Real thickness = thicknessNoise->evaluate(tile.position) * 0.5 + 0.5;
 			bf *= saturate(thickness * 0.5 + 0.7);
 			if (bf < 1e-7)
 				return;
+			counter.contributed = true;
 
 			const Vec3 color = Vec3(230) / 255;
 			const Real roughness = thickness * 0.3 + 0.2;
@@ -900,68 +990,135 @@ namespace unnatural
 			tile.height = saturate(tile.height);
 			tile.opacity = saturate(tile.opacity);
 		}
+
+		// the coloring modes evaluate one layer for the whole batch before moving to the next one
+		template<void (*F)(Tile &)>
+		void layer(PointerRange<Tile> tiles)
+		{
+			for (Tile &tile : tiles)
+				F(tile);
+		}
+
+		MeshPurposeEnum batchPurpose(PointerRange<Tile> tiles)
+		{
+			CAGE_ASSERT(!tiles.empty());
+			const MeshPurposeEnum purpose = tiles[0].meshPurpose;
+			for (const Tile &tile : tiles)
+			{
+				CAGE_ASSERT(tile.meshPurpose == purpose);
+				CAGE_ASSERT(isUnit(tile.normal));
+			}
+			return purpose;
+		}
+	}
+
+	void coloringLogStatistics()
+	{
+		for (uint32 i = 0; i < (uint32)LayerEnum::_Total; i++)
+		{
+			const uint64 e = layerEvaluations[i].load(std::memory_order_relaxed);
+			if (e == 0)
+				continue;
+			const uint64 s = layerSkips[i].load(std::memory_order_relaxed);
+			CAGE_LOG(SeverityEnum::Info, "coloring", Stringizer() + "layer " + layerNames[i] + ": evaluated " + e + " times, skipped " + (100.0 * s / e) + " %");
+		}
 	}
 
-	void coloringDefault(Tile &tile)
+	// the low-frequency fields, which may be evaluated at mesh vertices and interpolated
+	void coloringClimate(PointerRange<Tile> tiles)
 	{
-		generateElevation(tile);
-		generatePrecipitation(tile);
-		generateTemperature(tile);
-		generateSlope(tile);
-		generateBiome(tile);
-		generateType(tile);
-		if (tile.meshPurpose == MeshPurposeEnum::Water)
-			generateWater(tile);
+		layer<&generateElevation>(tiles);
+		layer<&generatePrecipitation>(tiles);
+		layer<&generateTemperature>(tiles);
+	}
+
+	void coloringDefault(PointerRange<Tile> tiles)
+	{
+		const MeshPurposeEnum purpose = batchPurpose(tiles);
+		layer<&generateElevation>(tiles);
+		layer<&generatePrecipitation>(tiles);
+		layer<&generateTemperature>(tiles);
+		layer<&generateSlope>(tiles);
+		layer<&generateBiome>(tiles);
+		layer<&generateType>(tiles);
+		if (purpose == MeshPurposeEnum::Navigation)
+		{
+			// properties only, the materials are not used for navigation
+			for (Tile &tile : tiles)
+				generateIceType(tile, iceMask(tile));
+			return;
+		}
+		if (purpose == MeshPurposeEnum::Water)
+			layer<&generateWater>(tiles);
 		else
 		{
-			generateBedrock(tile);
-			generateCliffs(tile);
-			generateMica(tile);
-			generateDirt(tile);
-			generateSand(tile);
-			generateGrass(tile);
-			generateBoulders(tile);
-		}
-		generateFlowers(tile);
-		generateIce(tile);
-		if (tile.meshPurpose != MeshPurposeEnum::Water)
-			generateSnow(tile);
-		generateFinalization(tile);
+			generateBedrock(tiles);
+			layer<&generateCliffs>(tiles);
+			layer<&generateMica>(tiles);
+			layer<&generateDirt>(tiles);
+			layer<&generateSand>(tiles);
+			layer<&generateGrass>(tiles);
+			layer<&generateBoulders>(tiles);
+		}
+		layer<&generateFlowers>(tiles);
+		layer<&generateIce>(tiles);
+		if (purpose != MeshPurposeEnum::Water)
+			layer<&generateSnow>(tiles);
+		layer<&generateFinalization>(tiles);
 	}
 
-	void coloringBarren(Tile &tile)
+	void coloringBarren(PointerRange<Tile> tiles)
 	{
-		generateElevation(tile);
-		generateSlope(tile);
-		if (tile.meshPurpose == MeshPurposeEnum::Water)
+		const MeshPurposeEnum purpose = batchPurpose(tiles);
+		layer<&generateElevation>(tiles);
+		layer<&generateSlope>(tiles);
+		for (Tile &tile : tiles)
 		{
-			tile.biome = TerrainBiomeEnum::Water;
-			tile.type = TerrainTypeEnum::Water;
-			generateWater(tile);
+			// barren planets have no climate
+			tile.temperature = 0;
+			tile.precipitation = 0;
+		}
+		if (purpose == MeshPurposeEnum::Water)
+		{
+			for (Tile &tile : tiles)
+			{
+				tile.biome = TerrainBiomeEnum::Water;
+				tile.type = TerrainTypeEnum::Water;
+			}
+			layer<&generateWater>(tiles);
 		}
 		else
 		{
-			tile.biome = TerrainBiomeEnum::Bare;
-			tile.type = TerrainTypeEnum::Flat;
-			generateBedrock(tile);
-			generateCliffs(tile);
-			generateMica(tile);
-			generateBoulders(tile);
+			for (Tile &tile : tiles)
+			{
+				tile.biome = TerrainBiomeEnum::Bare;
+				tile.type = TerrainTypeEnum::Flat;
+			}
+			if (purpose == MeshPurposeEnum::Navigation)
+				return; // properties only
+			generateBedrock(tiles);
+			layer<&generateCliffs>(tiles);
+			layer<&generateMica>(tiles);
+			layer<&generateBoulders>(tiles);
 		}
-		generateFinalization(tile);
+		layer<&generateFinalization>(tiles);
 	}
 
-	void coloringDebug(Tile &tile)
+	void coloringDebug(PointerRange<Tile> tiles)
 	{
-		generateElevation(tile);
-		generatePrecipitation(tile);
-		generateTemperature(tile);
-		generateSlope(tile);
-		generateBiome(tile);
-		generateType(tile);
-		generateVisualization(tile);
-		if (tile.meshPurpose == MeshPurposeEnum::Water)
-			tile.opacity = 0.5;
-		generateFinalization(tile);
+		const MeshPurposeEnum purpose = batchPurpose(tiles);
+		layer<&generateElevation>(tiles);
+		layer<&generatePrecipitation>(tiles);
+		layer<&generateTemperature>(tiles);
+		layer<&generateSlope>(tiles);
+		layer<&generateBiome>(tiles);
+		layer<&generateType>(tiles);
+		if (purpose == MeshPurposeEnum::Navigation)
+			return; // properties only
+		layer<&generateVisualization>(tiles);
+		if (purpose == MeshPurposeEnum::Water)
+			for (Tile &tile : tiles)
+				tile.opacity = 0.5;
+		layer<&generateFinalization>(tiles);
 	}
 }
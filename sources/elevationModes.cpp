@@ -1,19 +1,46 @@
+#include "bakedNoise.h"
+#include "fractalNoise.h"
 #include "math.h"
 #include "planets.h"
 #include "voronoi.h"
 
 #include <cage-core/noiseFunction.h>
+#include <cage-core/string.h>
 
 namespace unnatural
 {
-	Real elevationNone(const Vec3 &)
+	Real meshVoxelSize();
+	Real meshTileSize();
+	Real meshTexelSize();
+
+	namespace
 	{
-		return 100;
+		// scalar evaluation through the batch implementation, which owns the noise functions
+		template<void (*F)(PointerRange<const Vec3>, PointerRange<Real>)>
+		Real evaluateSingle(const Vec3 &pos)
+		{
+			Real result;
+			F({ &pos, &pos + 1 }, { &result, &result + 1 });
+			return result;
+		}
+
+		constexpr uint32 BatchSize = 512; // limits the temporary memory allocated on stack
+
+		// the positions of the legacy elevation noise are scaled by this range
+		constexpr Real LegacyScaleMin = 0.001;
+		constexpr Real LegacyScaleMax = 0.002;
 	}
 
-	Real elevationSimple(const Vec3 &pos)
+	void elevationNone(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		CAGE_ASSERT(positions.size() == results.size());
+		for (Real &r : results)
+			r = 100;
+	}
+
+	void elevationSimple(PointerRange<const Vec3> positions, PointerRange<Real> results)
 	{
-		static const Holder<NoiseFunction> elevNoise = []()
+		static const Holder<FractalNoise> elevNoise = []()
 		{
 			NoiseFunctionCreateConfig cfg;
 			cfg.type = NoiseTypeEnum::Simplex;
@@ -22,18 +49,22 @@ namespace unnatural
 			cfg.gain = 0.4;
 			cfg.frequency = 0.0005;
 			cfg.seed = noiseSeed();
-			return newNoiseFunction(cfg);
+			return newFractalNoise(cfg);
 		}();
 
-		Real a = elevNoise->evaluate(pos);
-		a = -a + 0.3; // min: -0.7, mean: 0.02, max: 1.1
-		a = pow(a * 1.3 - 0.35, 3) + 0.1;
-		return 100 - a * 1000;
+		CAGE_ASSERT(positions.size() == results.size());
+		elevNoise->evaluate(positions, results);
+		for (Real &a : results)
+		{
+			a = -a + 0.3; // min: -0.7, mean: 0.02, max: 1.1
+			a = pow(a * 1.3 - 0.35, 3) + 0.1;
+			a = 100 - a * 1000;
+		}
 	}
 
-	Real elevationLegacy(const Vec3 &pos)
+	void elevationLegacy(PointerRange<const Vec3> positions, PointerRange<Real> results)
 	{
-		static const Holder<NoiseFunction> scaleNoise = []()
+		static const Holder<FractalNoise> scaleNoise = []()
 		{
 			NoiseFunctionCreateConfig cfg;
 			cfg.type = NoiseTypeEnum::Value;
@@ -41,41 +72,63 @@ namespace unnatural
 			cfg.octaves = 4;
 			cfg.frequency = 0.0005;
 			cfg.seed = noiseSeed();
-			return newNoiseFunction(cfg);
+			return newFractalNoise(cfg);
 		}();
-		static const Holder<NoiseFunction> elevNoise = []()
+		static const Holder<FractalNoise> elevNoise = []()
 		{
 			NoiseFunctionCreateConfig cfg;
 			cfg.type = NoiseTypeEnum::Value;
 			cfg.fractalType = NoiseFractalTypeEnum::Fbm;
 			cfg.octaves = 4;
 			cfg.seed = noiseSeed();
-			return newNoiseFunction(cfg);
+			return newFractalNoise(cfg, 2000 * LegacyScaleMax);
 		}();
 
-		Real scale = scaleNoise->evaluate(pos) * 0.0005 + 0.0015;
-		Real a = elevNoise->evaluate(pos * scale);
-		a += 0.11; // slightly prefer terrain over ocean
-		if (a < 0)
-			a = -pow(-a, 0.85);
-		else
-			a = pow(a, 1.7);
-		return a * 2500;
+		CAGE_ASSERT(positions.size() == results.size());
+		const uint32 total = numeric_cast<uint32>(positions.size());
+		const Real footprint = samplingFootprint();
+		Vec3 *const scaled = (Vec3 *)CAGE_ALLOCA(min(total, BatchSize) * sizeof(Vec3));
+		for (uint32 offset = 0; offset < total; offset += BatchSize)
+		{
+			const uint32 cnt = min(total - offset, BatchSize);
+			const PointerRange<const Vec3> ps = { positions.data() + offset, positions.data() + offset + cnt };
+			const PointerRange<Real> rs = { results.data() + offset, results.data() + offset + cnt };
+			scaleNoise->evaluate(ps, rs);
+			Real minScale = LegacyScaleMax;
+			for (uint32 i = 0; i < cnt; i++)
+			{
+				const Real scale = rs[i] * 0.0005 + 0.0015;
+				scaled[i] = ps[i] * scale;
+				minScale = min(minScale, scale);
+			}
+			// the footprint is scaled with the positions, the smallest scale keeps all octaves representable at any of the positions
+			elevNoise->evaluate({ scaled, scaled + cnt }, rs, footprint * max(minScale, LegacyScaleMin));
+			for (Real &a : rs)
+			{
+				a += 0.11; // slightly prefer terrain over ocean
+				if (a < 0)
+					a = -pow(-a, 0.85);
+				else
+					a = pow(a, 1.7);
+				a *= 2500;
+			}
+		}
 	}
 
 	namespace
 	{
-		Real commonElevationMountains(const Vec3 &pos, Real land)
+		// results contain the land elevation on input
+		void commonElevationMountains(PointerRange<const Vec3> positions, PointerRange<Real> results)
 		{
-			static const Holder<NoiseFunction> maskNoise = []()
+			static const Holder<BakedNoise> maskNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Perlin;
 				cfg.frequency = 0.0015;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newBakedNoise(cfg, "mountains mask");
 			}();
-			static const Holder<NoiseFunction> ridgeNoise = []()
+			static const Holder<FractalNoise> ridgeNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Simplex;
@@ -85,9 +138,9 @@ namespace unnatural
 				cfg.gain = -0.4;
 				cfg.frequency = 0.001;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
-			static const Holder<NoiseFunction> terraceNoise = []()
+			static const Holder<FractalNoise> terraceNoise = []()
 			{
 				NoiseFunctionCreateConfig cfg;
 				cfg.type = NoiseTypeEnum::Perlin;
@@ -96,39 +149,72 @@ namespace unnatural
 				cfg.gain = 0.3;
 				cfg.frequency = 0.002;
 				cfg.seed = noiseSeed();
-				return newNoiseFunction(cfg);
+				return newFractalNoise(cfg);
 			}();
 
-			Real cover = 1 - saturate(land * -0.1);
-			if (cover < 1e-7)
-				return land;
+			CAGE_ASSERT(positions.size() == results.size());
+			const uint32 total = numeric_cast<uint32>(positions.size());
+			const uint32 tmpSize = min(total, BatchSize);
+			Vec3 *const ps = (Vec3 *)CAGE_ALLOCA(tmpSize * sizeof(Vec3));
+			uint32 *const ids = (uint32 *)CAGE_ALLOCA(tmpSize * sizeof(uint32));
+			Real *const masks = (Real *)CAGE_ALLOCA(tmpSize * sizeof(Real));
+			Real *const ridges = (Real *)CAGE_ALLOCA(tmpSize * sizeof(Real));
+			Real *const terracess = (Real *)CAGE_ALLOCA(tmpSize * sizeof(Real));
+			for (uint32 offset = 0; offset < total; offset += BatchSize)
+			{
+				const uint32 end = min(total, offset + BatchSize);
+
+				// only positions with some land cover need the noises
+				uint32 cnt = 0;
+				for (uint32 i = offset; i < end; i++)
+				{
+					const Real cover = 1 - saturate(results[i] * -0.1);
+					if (cover < 1e-7)
+						continue;
+					ps[cnt] = positions[i];
+					ids[cnt] = i;
+					cnt++;
+				}
+				if (cnt == 0)
+					continue;
 
-			Real mask = maskNoise->evaluate(pos);
-			Real rm = smoothstep(saturate(mask * +7 - 0.3));
-			Real tm = smoothstep(saturate(mask * -7 - 1.5));
+				maskNoise->evaluate({ ps, ps + cnt }, { masks, masks + cnt });
+				ridgeNoise->evaluate({ ps, ps + cnt }, { ridges, ridges + cnt });
+				terraceNoise->evaluate({ ps, ps + cnt }, { terracess, terracess + cnt });
 
-			Real ridge = ridgeNoise->evaluate(pos);
-			ridge = max(ridge - 0.1, 0);
-			ridge = pow(ridge, 1.6);
-			ridge *= rm * cover;
-			ridge *= 1000;
+				for (uint32 j = 0; j < cnt; j++)
+				{
+					Real &land = results[ids[j]];
+					const Real cover = 1 - saturate(land * -0.1);
 
-			Real terraces = terraceNoise->evaluate(pos);
-			terraces = max(terraces + 0.1, 0) * 2.5;
-			terraces = terrace(terraces, 4);
-			terraces *= tm * cover;
-			terraces *= 250;
+					const Real mask = masks[j];
+					const Real rm = smoothstep(saturate(mask * +7 - 0.3));
+					const Real tm = smoothstep(saturate(mask * -7 - 1.5));
 
-			return land + smoothMax(0, max(ridge, terraces), 50);
+					Real ridge = ridges[j];
+					ridge = max(ridge - 0.1, 0);
+					ridge = pow(ridge, 1.6);
+					ridge *= rm * cover;
+					ridge *= 1000;
+
+					Real terraces = terracess[j];
+					terraces = max(terraces + 0.1, 0) * 2.5;
+					terraces = terrace(terraces, 4);
+					terraces *= tm * cover;
+					terraces *= 250;
+
+					land += smoothMax(0, max(ridge, terraces), 50);
+				}
+			}
 		}
 	}
 
 	// lakes & islands
 	// https://www.wolframalpha.com/input/?i=plot+%28%28%281+-+x%5E0.85%29+*+2+-+1%29+%2F+%28abs%28%28%281+-+x%5E0.85%29+*+2+-+1%29%29+%2B+0.17%29+%2B+0.15%29+*+150+%2C+%28%28%281+-+x%5E1.24%29+*+2+-+1%29+%2F+%28abs%28%28%281+-+x%5E1.24%29+*+2+-+1%29%29+%2B+0.17%29+%2B+0.15%29+*+150+%2C+x+%3D+0+..+1
 
-	Real elevationLakes(const Vec3 &pos)
+	void elevationLakes(PointerRange<const Vec3> positions, PointerRange<Real> results)
 	{
-		static const Holder<NoiseFunction> elevLand = []()
+		static const Holder<BakedNoise> elevLand = []()
 		{
 			NoiseFunctionCreateConfig cfg;
 			cfg.type = NoiseTypeEnum::Value;
@@ -136,21 +222,26 @@ namespace unnatural
 			cfg.octaves = 4;
 			cfg.frequency = 0.0013;
 			cfg.seed = noiseSeed();
-			return newNoiseFunction(cfg);
+			return newBakedNoise(cfg, "land");
 		}();
 
-		Real land = elevLand->evaluate(pos) * 0.5 + 0.5;
-		land = saturate(land);
-		land = 1 - pow(land, 1.24);
-		land = land * 2 - 1;
-		land = land / (abs(land) + 0.17) + 0.15;
-		land *= 150;
-		return commonElevationMountains(pos, land);
+		CAGE_ASSERT(positions.size() == results.size());
+		elevLand->evaluate(positions, results);
+		for (Real &land : results)
+		{
+			land = land * 0.5 + 0.5;
+			land = saturate(land);
+			land = 1 - pow(land, 1.24);
+			land = land * 2 - 1;
+			land = land / (abs(land) + 0.17) + 0.15;
+			land *= 150;
+		}
+		commonElevationMountains(positions, results);
 	}
 
-	Real elevationIslands(const Vec3 &pos)
+	void elevationIslands(PointerRange<const Vec3> positions, PointerRange<Real> results)
 	{
-		static const Holder<NoiseFunction> elevLand = []()
+		static const Holder<BakedNoise> elevLand = []()
 		{
 			NoiseFunctionCreateConfig cfg;
 			cfg.type = NoiseTypeEnum::Value;
@@ -158,19 +249,24 @@ namespace unnatural
 			cfg.octaves = 4;
 			cfg.frequency = 0.0013;
 			cfg.seed = noiseSeed();
-			return newNoiseFunction(cfg);
+			return newBakedNoise(cfg, "land");
 		}();
 
-		Real land = elevLand->evaluate(pos) * 0.5 + 0.5;
-		land = saturate(land);
-		land = 1 - pow(land, 0.83);
-		land = land * 2 - 1;
-		land = land / (abs(land) + 0.17) + 0.15;
-		land *= 150;
-		return commonElevationMountains(pos, land);
+		CAGE_ASSERT(positions.size() == results.size());
+		elevLand->evaluate(positions, results);
+		for (Real &land : results)
+		{
+			land = land * 0.5 + 0.5;
+			land = saturate(land);
+			land = 1 - pow(land, 0.83);
+			land = land * 2 - 1;
+			land = land / (abs(land) + 0.17) + 0.15;
+			land *= 150;
+		}
+		commonElevationMountains(positions, results);
 	}
 
-	Real elevationCraters(const Vec3 &pos)
+	void elevationCraters(PointerRange<const Vec3> positions, PointerRange<Real> results)
 	{
 		static const Holder<Voronoi> impactsNoise = []()
 		{
@@ -190,10 +286,90 @@ namespace unnatural
 		}();
 		static const auto &crater = [](Real x) { return (pow(x, 4) - 0.9 * pow(x, 5) - 0.1) * 10; }; // 0..1 -> -1..0.2
 
-		const Vec3 c = impactsNoise->evaluate(pos, Vec3::Nan()).points[0];
-		const Real s = 100 + scaleNoise->evaluate(c) * 50;
-		const Real d = distance(pos, c);
-		const Real h = crater(saturate(d / s));
-		return 200 + h * 190;
+		CAGE_ASSERT(positions.size() == results.size());
+		const uint32 total = numeric_cast<uint32>(positions.size());
+		Vec3 *const centers = (Vec3 *)CAGE_ALLOCA(min(total, BatchSize) * sizeof(Vec3));
+		VoronoiResult *const impacts = (VoronoiResult *)CAGE_ALLOCA(min(total, BatchSize) * sizeof(VoronoiResult));
+		for (uint32 offset = 0; offset < total; offset += BatchSize)
+		{
+			const uint32 cnt = min(total - offset, BatchSize);
+			const PointerRange<const Vec3> ps = { positions.data() + offset, positions.data() + offset + cnt };
+			const PointerRange<Real> rs = { results.data() + offset, results.data() + offset + cnt };
+			impactsNoise->evaluate(ps, {}, { impacts, impacts + cnt });
+			for (uint32 i = 0; i < cnt; i++)
+				centers[i] = impacts[i].points[0];
+			scaleNoise->evaluate({ centers, centers + cnt }, rs);
+			for (uint32 i = 0; i < cnt; i++)
+			{
+				const Real s = 100 + rs[i] * 50;
+				const Real d = distance(ps[i], centers[i]);
+				const Real h = crater(saturate(d / s));
+				rs[i] = 200 + h * 190;
+			}
+		}
+	}
+
+	Real elevationNone(const Vec3 &pos)
+	{
+		return evaluateSingle<&elevationNone>(pos);
+	}
+
+	Real elevationSimple(const Vec3 &pos)
+	{
+		return evaluateSingle<&elevationSimple>(pos);
+	}
+
+	Real elevationLegacy(const Vec3 &pos)
+	{
+		return evaluateSingle<&elevationLegacy>(pos);
+	}
+
+	Real elevationLakes(const Vec3 &pos)
+	{
+		return evaluateSingle<&elevationLakes>(pos);
+	}
+
+	Real elevationIslands(const Vec3 &pos)
+	{
+		return evaluateSingle<&elevationIslands>(pos);
+	}
+
+	Real elevationCraters(const Vec3 &pos)
+	{
+		return evaluateSingle<&elevationCraters>(pos);
+	}
+
+	void elevationValidate()
+	{
+		// all octaves of the legacy elevation are representable at the footprints of the meshing, tiles and textures
+		// therefore the octaves culling must not change it, which verifies that the footprint is scaled together with the positions
+		static constexpr Real Tolerance = 1e-3;
+		std::vector<Vec3> positions;
+		for (sint32 z = -10; z <= 10; z++)
+			for (sint32 y = -10; y <= 10; y++)
+				for (sint32 x = -10; x <= 10; x++)
+					positions.push_back(Vec3(x, y, z) * 200 + Vec3(3, 7, 13));
+		std::vector<Real> full, culled;
+		full.resize(positions.size());
+		culled.resize(positions.size());
+		{
+			const SamplingFootprint footprint(0);
+			elevationLegacy(positions, full);
+		}
+		for (const Real f : { meshVoxelSize(), meshTileSize(), meshTexelSize() })
+		{
+			{
+				const SamplingFootprint footprint(f);
+				elevationLegacy(positions, culled);
+			}
+			for (uint32 i = 0; i < positions.size(); i++)
+			{
+				if (abs(full[i] - culled[i]) > Tolerance)
+				{
+					CAGE_LOG_THROW(Stringizer() + "footprint: " + f + ", position: " + positions[i] + ", full: " + full[i] + ", culled: " + culled[i]);
+					CAGE_THROW_ERROR(Exception, "octaves culling changed the legacy elevation");
+				}
+			}
+		}
 	}
 }
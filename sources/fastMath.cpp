@@ -0,0 +1,63 @@
+#include <cmath>
+
+#include "fastMath.h"
+
+#include <cage-core/string.h>
+
+namespace unnatural
+{
+	namespace
+	{
+		template<class Approx, class Reference>
+		void validate(const char *name, Real a, Real b, Real bound, Approx &&approx, Reference &&reference)
+		{
+			static constexpr uint32 Samples = 100000;
+			double worst = 0;
+			Real worstInput;
+			for (uint32 i = 0; i <= Samples; i++)
+			{
+				const Real x = interpolate(a, b, Real(i) / Samples);
+				const double r = reference(double(x.value));
+				const double e = std::abs(double(approx(x).value) - r) / std::max(1.0, std::abs(r));
+				if (e > worst)
+				{
+					worst = e;
+					worstInput = x;
+				}
+			}
+			if (worst > bound.value)
+			{
+				CAGE_LOG_THROW(Stringizer() + "function: " + name + ", input: " + worstInput + ", error: " + Real(worst));
+				CAGE_THROW_ERROR(Exception, "fast math approximation exceeds its error bound");
+			}
+		}
+	}
+
+	void fastMathValidate()
+	{
+		validate(
+			"sin", -1e4, 1e4, 1e-6, [](Real x) { return fastSin(Rads(x)); }, [](double x) { return std::sin(x); });
+		validate(
+			"sin", 1e4, 1e7, 1e-6, [](Real x) { return fastSin(Rads(x)); }, [](double x) { return std::sin(x); });
+		validate(
+			"sin", -10, 10, 1e-6, [](Real x) { return fastSin(Rads(x)); }, [](double x) { return std::sin(x); });
+		validate(
+			"cos", -10, 10, 1e-6, [](Real x) { return fastCos(Rads(x)); }, [](double x) { return std::cos(x); });
+		validate(
+			"atan", -100, 100, 2e-6, [](Real x) { return fastAtan(x).value; }, [](double x) { return std::atan(x); });
+		validate(
+			"atan2", -3.14, 3.14, 2e-6, [](Real x) { return fastAtan2(std::cos(x.value) * 10, std::sin(x.value) * 10).value; }, [](double x) { return std::atan2(double(std::sin(float(x)) * 10), double(std::cos(float(x)) * 10)); });
+		validate(
+			"acos", -1, 1, 1e-6, [](Real x) { return fastAcos(x).value; }, [](double x) { return std::acos(x); });
+		validate(
+			"log", 1e-6, 10, 1e-6, [](Real x) { return fastLog(x); }, [](double x) { return std::log(x); });
+		validate(
+			"log", 10, 1e6, 1e-6, [](Real x) { return fastLog(x); }, [](double x) { return std::log(x); });
+		validate(
+			"exp", -80, 80, 1e-6, [](Real x) { return fastExp(x); }, [](double x) { return std::exp(x); });
+		validate(
+			"pow", 0, 4, 2e-6, [](Real x) { return fastPow(x, 3); }, [](double x) { return std::pow(x, 3.0); });
+		validate(
+			"pow", 0, 1, 2e-6, [](Real x) { return fastPow(x, 0.3); }, [](double x) { return std::pow(x, 0.3); });
+	}
+}
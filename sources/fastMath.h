@@ -0,0 +1,155 @@
+#ifndef fastMath_h_h4s8zq1w
+#define fastMath_h_h4s8zq1w
+
+#include <bit>
+#include <cmath>
+
+#include "math.h"
+
+// approximations of the elementary functions for hot loops
+// the functions are inline and branch-free (selects only) in their fast ranges, so that loops calling them can be vectorized by the compiler
+// error bounds are verified by fastMathValidate
+
+namespace unnatural
+{
+	namespace fastMathDetail
+	{
+		inline float floor(float x)
+		{
+			// floats of this magnitude are integers already, and excluding them (and nan) keeps the conversion to int defined
+			const bool big = !(std::abs(x) < 8388608.f);
+			const float t = (float)(int)(big ? 0.f : x);
+			const float f = t > x ? t - 1 : t;
+			return big ? x : f;
+		}
+
+		// 2^k for integer k in -126 .. 127
+		inline float exp2i(int k)
+		{
+			return std::bit_cast<float>((k + 127) << 23);
+		}
+
+		// sine on -pi/2 .. pi/2
+		inline float sinKernel(float r)
+		{
+			const float r2 = r * r;
+			return r + r * r2 * (-1.6666667e-1f + r2 * (8.3333338e-3f + r2 * (-1.9841270e-4f + r2 * (2.7557314e-6f - r2 * 2.5052108e-8f))));
+		}
+
+		// arc tangent on -1 .. 1
+		inline float atanKernel(float x)
+		{
+			const float x2 = x * x;
+			return x * (0.99997726f + x2 * (-0.33262347f + x2 * (0.19354346f + x2 * (-0.11643287f + x2 * (0.05265332f - x2 * 0.01172120f)))));
+		}
+	}
+
+	// absolute error below 1e-6 for |x| <= 1e4
+	// larger inputs (eg. from sdf expressions) fall back to the standard sine
+	inline Real fastSin(Rads x)
+	{
+		using namespace fastMathDetail;
+		static constexpr float InvPi = 0.318309886183790671538f;
+		static constexpr float PiHi = 3.140625f; // exactly representable multiples for |k| < 2^16
+		static constexpr float PiLo = 9.67653589793e-4f;
+		const float v = x.value.value;
+		if (!(std::abs(v) <= 1e4f)) [[unlikely]]
+			return std::sin(v);
+		const float k = floor(v * InvPi + 0.5f);
+		const float r = (v - k * PiHi) - k * PiLo;
+		const float s = sinKernel(r);
+		return ((int)k & 1) ? -s : s;
+	}
+
+	// absolute error below 1e-6 for |x| <= 1e4
+	// larger inputs fall back to the standard sine
+	inline Real fastCos(Rads x)
+	{
+		return fastSin(x + Rads(Real::Pi() * 0.5));
+	}
+
+	// absolute error below 2e-6 rad
+	inline Rads fastAtan(Real x)
+	{
+		using namespace fastMathDetail;
+		static constexpr float HalfPi = 1.57079632679489661923f;
+		const float v = x.value;
+		const float a = std::abs(v);
+		const bool inv = a > 1;
+		const float t = atanKernel(inv ? 1 / a : a);
+		const float r = inv ? HalfPi - t : t;
+		return Rads(v < 0 ? -r : r);
+	}
+
+	// angle of the vector (x, y), ie. std::atan2(y, x)
+	// same argument order as atan2 in cage
+	// absolute error below 2e-6 rad
+	inline Rads fastAtan2(Real x, Real y)
+	{
+		using namespace fastMathDetail;
+		static constexpr float Pi = 3.14159265358979323846f;
+		static constexpr float HalfPi = 1.57079632679489661923f;
+		const float ax = std::abs(x.value);
+		const float ay = std::abs(y.value);
+		const float mx = ax > ay ? ax : ay;
+		const float mn = ax > ay ? ay : ax;
+		float r = atanKernel(mx > 0 ? mn / mx : 0);
+		r = ay > ax ? HalfPi - r : r;
+		r = x.value < 0 ? Pi - r : r;
+		return Rads(y.value < 0 ? -r : r);
+	}
+
+	// absolute error below 1e-6 rad for x in -1 .. 1
+	inline Rads fastAcos(Real x)
+	{
+		// Abramowitz and Stegun 4.4.46
+		static constexpr float Pi = 3.14159265358979323846f;
+		const float v = x.value;
+		const float a = std::abs(v) < 1 ? std::abs(v) : 1;
+		const float p = 1.5707963050f + a * (-0.2145988016f + a * (0.0889789874f + a * (-0.0501743046f + a * (0.0308918810f + a * (-0.0170881256f + a * (0.0066700901f - a * 0.0012624911f))))));
+		const float r = std::sqrt(1 - a) * p;
+		return Rads(v < 0 ? Pi - r : r);
+	}
+
+	// natural logarithm
+	// absolute error below 1e-6 * max(1, |log(x)|) for positive normal x
+	inline Real fastLog(Real x)
+	{
+		static constexpr float Ln2 = 0.693147180559945309417f;
+		const int bits = std::bit_cast<int>(x.value);
+		// split into mantissa in sqrt(0.5) .. sqrt(2) and exponent
+		const int e = ((bits - 0x3f3504f3) >> 23);
+		const float m = std::bit_cast<float>(bits - (e << 23));
+		const float s = (m - 1) / (m + 1);
+		const float s2 = s * s;
+		const float l = 2 * s * (1 + s2 * (0.33333333f + s2 * (0.2f + s2 * (0.14285714f + s2 * 0.11111111f))));
+		return e * Ln2 + l;
+	}
+
+	// relative error below 1e-6 for |x| <= 87
+	inline Real fastExp(Real x)
+	{
+		using namespace fastMathDetail;
+		static constexpr float InvLn2 = 1.44269504088896340736f;
+		static constexpr float Ln2Hi = 0.693145751953125f;
+		static constexpr float Ln2Lo = 1.42860682030941723212e-6f;
+		const float v = x.value < -87 ? -87 : x.value > 87 ? 87 : x.value;
+		const float k = floor(v * InvLn2 + 0.5f);
+		const float r = (v - k * Ln2Hi) - k * Ln2Lo;
+		const float p = 1 + r * (1 + r * (0.5f + r * (1.6666667e-1f + r * (4.1666668e-2f + r * (8.3333338e-3f + r * (1.3888889e-3f + r * 1.9841270e-4f))))));
+		return p * exp2i((int)k);
+	}
+
+	// base raised to the exponent, for non-negative base
+	// relative error below 1e-6 * max(1, |exponent * log(base)|) for |exponent * log(base)| <= 87
+	inline Real fastPow(Real base, Real exponent)
+	{
+		const Real r = fastExp(exponent * fastLog(base));
+		return base.value > 0 ? r : Real();
+	}
+
+	// throws if any approximation exceeds its documented bounds
+	void fastMathValidate();
+}
+
+#endif
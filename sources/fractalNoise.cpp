@@ -0,0 +1,174 @@
+#include <vector>
+
+#include "fractalNoise.h"
+
+#include <cage-core/random.h>
+#include <cage-core/string.h>
+
+namespace unnatural
+{
+	namespace
+	{
+		thread_local Real currentFootprint = 0;
+
+		constexpr uint32 CalibrationSamples = 1000;
+	}
+
+	Real samplingFootprint()
+	{
+		return currentFootprint;
+	}
+
+	SamplingFootprint::SamplingFootprint(Real footprint) : previous(currentFootprint)
+	{
+		CAGE_ASSERT(footprint >= 0);
+		currentFootprint = footprint;
+	}
+
+	SamplingFootprint::~SamplingFootprint()
+	{
+		currentFootprint = previous;
+	}
+
+	class FractalNoiseImpl : public FractalNoise
+	{
+	public:
+		// variants[i] is the noise with i + 1 octaves, the last one is the full noise
+		std::vector<Holder<NoiseFunction>> variants;
+		// the full noise is approximated as variant * scale + offset
+		std::vector<Real> scales;
+		std::vector<Real> offsets;
+		Real frequency;
+		Real lacunarity;
+
+		FractalNoiseImpl(const NoiseFunctionCreateConfig &cfg, Real extent) : frequency(cfg.frequency), lacunarity(cfg.lacunarity)
+		{
+			if (cfg.fractalType == NoiseFractalTypeEnum::None || cfg.octaves <= 1 || lacunarity <= 1)
+			{
+				variants.push_back(newNoiseFunction(cfg));
+				scales.push_back(1);
+				offsets.push_back(0);
+				return;
+			}
+
+			// the fractal sum is normalized by the sum of the octaves amplitudes
+			std::vector<Real> amplitudes;
+			{
+				Real a = 1, s = 0;
+				for (uint32 i = 0; i < cfg.octaves; i++)
+				{
+					s += a;
+					amplitudes.push_back(s);
+					a *= abs(cfg.gain);
+				}
+			}
+
+			for (uint32 i = 0; i < cfg.octaves; i++)
+			{
+				NoiseFunctionCreateConfig c = cfg;
+				c.octaves = i + 1;
+				variants.push_back(newNoiseFunction(c));
+				scales.push_back(amplitudes[i] / amplitudes.back());
+			}
+
+			// estimate the mean of the skipped octaves and verify that the variants are prefixes of the full sum
+			std::vector<Vec3> positions;
+			positions.reserve(CalibrationSamples);
+			RandomGenerator rng(hash(cfg.seed), 0x3c6ef372);
+			for (uint32 i = 0; i < CalibrationSamples; i++)
+				positions.push_back(rng.randomRange3(-extent, extent));
+			std::vector<Real> full, partial;
+			full.resize(CalibrationSamples);
+			partial.resize(CalibrationSamples);
+			variants.back()->evaluate(positions, full);
+			offsets.resize(cfg.octaves);
+			for (uint32 i = 0; i + 1 < cfg.octaves; i++)
+			{
+				variants[i]->evaluate(positions, partial);
+				Real sum = 0;
+				for (uint32 j = 0; j < CalibrationSamples; j++)
+					sum += full[j] - partial[j] * scales[i];
+				offsets[i] = sum / CalibrationSamples;
+				Real deviation = 0;
+				for (uint32 j = 0; j < CalibrationSamples; j++)
+					deviation = max(deviation, abs(full[j] - partial[j] * scales[i] - offsets[i]));
+				// each skipped octave contributes at most its amplitude, with some slack for noise types that slightly overshoot
+				if (deviation > (1 - scales[i]) * 2.5 + 1e-3)
+				{
+					CAGE_LOG(SeverityEnum::Warning, "fractalNoise", Stringizer() + "octaves culling disabled for noise with frequency: " + cfg.frequency + ", octaves: " + cfg.octaves + ", deviation: " + deviation);
+					Holder<NoiseFunction> f = std::move(variants.back());
+					variants.clear();
+					variants.push_back(std::move(f));
+					scales = { 1 };
+					offsets = { 0 };
+					return;
+				}
+			}
+		}
+
+		// index of the variant with all octaves above the nyquist limit of the footprint
+		uint32 variant(Real footprint) const
+		{
+			const uint32 cnt = numeric_cast<uint32>(variants.size());
+			if (cnt == 1 || !(footprint > 0))
+				return cnt - 1;
+			Real f = frequency * footprint;
+			uint32 i = 0;
+			while (i + 1 < cnt && f * lacunarity < 0.5)
+			{
+				f *= lacunarity;
+				i++;
+			}
+			return i;
+		}
+
+		Real evaluate(const Vec3 &position, Real footprint) const
+		{
+			const uint32 v = variant(footprint);
+			if (v + 1 == variants.size())
+				return variants[v]->evaluate(position);
+			return clamp(variants[v]->evaluate(position) * scales[v] + offsets[v], -1, 1);
+		}
+
+		void evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results, Real footprint) const
+		{
+			CAGE_ASSERT(positions.size() == results.size());
+			const uint32 v = variant(footprint);
+			variants[v]->evaluate(positions, results);
+			if (v + 1 == variants.size())
+				return;
+			for (Real &r : results)
+				r = clamp(r * scales[v] + offsets[v], -1, 1); // keeps the range of the full noise
+		}
+	};
+
+	Real FractalNoise::evaluate(const Vec3 &position) const
+	{
+		const FractalNoiseImpl *impl = (const FractalNoiseImpl *)this;
+		return impl->evaluate(position, currentFootprint);
+	}
+
+	void FractalNoise::evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results) const
+	{
+		const FractalNoiseImpl *impl = (const FractalNoiseImpl *)this;
+		impl->evaluate(positions, results, currentFootprint);
+	}
+
+	Real FractalNoise::evaluate(const Vec3 &position, Real footprint) const
+	{
+		const FractalNoiseImpl *impl = (const FractalNoiseImpl *)this;
+		return impl->evaluate(position, footprint);
+	}
+
+	void FractalNoise::evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results, Real footprint) const
+	{
+		const FractalNoiseImpl *impl = (const FractalNoiseImpl *)this;
+		impl->evaluate(positions, results, footprint);
+	}
+
+	Holder<FractalNoise> newFractalNoise(const NoiseFunctionCreateConfig &cfg, Real extent)
+	{
+		CAGE_ASSERT(extent > 0);
+		return systemMemory().createImpl<FractalNoise, FractalNoiseImpl>(cfg, extent);
+	}
+}
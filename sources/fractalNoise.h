@@ -0,0 +1,42 @@
+#ifndef fractalNoise_h_q8d3m6tz
+#define fractalNoise_h_q8d3m6tz
+
+#include "planets.h"
+
+#include <cage-core/noiseFunction.h>
+
+namespace unnatural
+{
+	// distance between neighboring samples of the current evaluation on this thread
+	// zero means unlimited detail
+	Real samplingFootprint();
+
+	// sets the sampling footprint for the current thread for the lifetime of the object
+	struct SamplingFootprint : private Immovable
+	{
+		explicit SamplingFootprint(Real footprint);
+		~SamplingFootprint();
+
+	private:
+		Real previous;
+	};
+
+	// fractal noise function that skips octaves, which cannot be represented at the sampling footprint
+	// the skipped octaves are replaced by their mean value, and the result is clamped to -1 .. 1 like the full noise
+	class FractalNoise : private Immovable
+	{
+	public:
+		// uses the sampling footprint of the current thread
+		Real evaluate(const Vec3 &position) const;
+		void evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results) const;
+
+		// the footprint must be in the space of the positions, ie. scaled together with them
+		Real evaluate(const Vec3 &position, Real footprint) const;
+		void evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results, Real footprint) const;
+	};
+
+	// the skipped octaves are calibrated on positions within -extent .. extent, which should match the space of the evaluated positions
+	Holder<FractalNoise> newFractalNoise(const NoiseFunctionCreateConfig &cfg, Real extent = 2000);
+}
+
+#endif
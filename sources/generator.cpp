@@ -1,13 +1,14 @@
 #include <algorithm>
 #include <chrono>
 #include <ctime>
+#include <deque>
+#include <numeric>
 
 #include "planets.h"
 
 #include <cage-core/concurrent.h>
 #include <cage-core/config.h>
 #include <cage-core/debug.h>
-#include <cage-core/imageAlgorithms.h>
 #include <cage-core/mesh.h>
 #include <cage-core/process.h>
 #include <cage-core/string.h>
@@ -16,10 +17,9 @@
 namespace unnatural
 {
 	void terrainPreseed();
+	void coloringLogStatistics();
 	bool terrainDoublesided();
-	Holder<Mesh> meshGenerateBaseLand();
-	Holder<Mesh> meshGenerateBaseWater();
-	Holder<Mesh> meshGenerateBaseNavigation();
+	void meshGenerateBase(Holder<Mesh> &land, Holder<Mesh> &water, Holder<Mesh> &navigation);
 	Holder<PointerRange<Holder<Mesh>>> meshSplit(const Holder<Mesh> &mesh);
 	void meshSimplifyCollider(Holder<Mesh> &mesh);
 	void meshSimplifyNavmesh(Holder<Mesh> &mesh, const Mesh *collider);
@@ -29,8 +29,9 @@ namespace unnatural
 	void meshSaveRender(const Holder<Mesh> &mesh, const String &path, bool transparency);
 	void meshSaveNavigation(const Holder<Mesh> &mesh);
 	void meshSaveCollider(const Holder<Mesh> &mesh);
-	void generateTexturesLand(const Holder<Mesh> &renderMesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &special, Holder<Image> &heightMap);
-	void generateTexturesWater(const Holder<Mesh> &renderMesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &special, Holder<Image> &heightMap);
+	void generateTexturesLand(const Holder<Mesh> &renderMesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &pbr, Holder<Image> &normal);
+	void generateTexturesWater(const Holder<Mesh> &renderMesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &pbr, Holder<Image> &normal);
+	uint64 texturesMemoryEstimate(uint32 width, uint32 height);
 	void generateTileProperties(const Holder<Mesh> &navMesh);
 	void generateDoodads();
 	void generateStartingPositions();
@@ -57,6 +58,7 @@ namespace unnatural
 	{
 		const ConfigBool configDebugSaveIntermediate("unnatural-planets/debug/saveIntermediate");
 		const ConfigBool configPreviewEnable("unnatural-planets/preview/enable");
+		const ConfigUint32 configTexturesMemoryBudget("unnatural-planets/textures/memoryBudget");
 		const String planetName = generateName();
 
 		struct Chunk
@@ -89,13 +91,134 @@ namespace unnatural
 		std::vector<Chunk> chunks;
 		Holder<Mutex> chunksMutex = newMutex();
 
+		// chunks are unwrapped first to know their texture sizes, and then processed largest first
+		struct ChunksSchedule
+		{
+			PointerRange<Holder<Mesh>> meshes;
+			std::vector<uint32> resolutions;
+			std::vector<uint32> order; // chunk indices in the order of processing
+
+			void unwrapEntry(uint32 index) { resolutions[index] = meshUnwrap(meshes[index]); }
+
+			void prepare(PointerRange<Holder<Mesh>> chunkMeshes)
+			{
+				meshes = chunkMeshes;
+				const uint32 cnt = numeric_cast<uint32>(meshes.size());
+				resolutions.resize(cnt);
+				tasksRunBlocking("chunk unwrap", Delegate<void(uint32)>().bind<ChunksSchedule, &ChunksSchedule::unwrapEntry>(this), cnt);
+				order.resize(cnt);
+				std::iota(order.begin(), order.end(), 0);
+				std::stable_sort(order.begin(), order.end(), [&](uint32 a, uint32 b) { return resolutions[a] > resolutions[b]; });
+				uint64 total = 0;
+				for (uint32 r : resolutions)
+					total += texturesMemoryEstimate(r, r);
+				CAGE_LOG(SeverityEnum::Info, "generator", Stringizer() + "estimated textures memory of all chunks: " + (total / 1024 / 1024) + " MB, largest chunk: " + (cnt ? texturesMemoryEstimate(resolutions[order[0]], resolutions[order[0]]) / 1024 / 1024 : 0) + " MB");
+			}
+		};
+
+		// limits the estimated memory of textures of all chunks (land and water) generated concurrently
+		// the chunk tasks are submitted to the tasks pool only once they are admitted, therefore no pool worker ever waits for the budget
+		// a chunk is always admitted when no other chunk is in progress, even if it exceeds the budget alone
+		struct TexturesScheduler
+		{
+			struct Job
+			{
+				TexturesScheduler *scheduler = nullptr;
+				Delegate<void(uint32)> entry;
+				uint32 task = 0;
+				uint64 bytes = 0;
+				bool admitted = false;
+				Holder<AsyncTask> taskRef;
+
+				void run(uint32)
+				{
+					struct Release
+					{
+						Job *job;
+						~Release() { job->scheduler->finished(job->bytes); }
+					} release{ this };
+					entry(task);
+				}
+			};
+
+			Holder<Mutex> mutex = newMutex();
+			Holder<ConditionalVariable> cond = newConditionalVariable();
+			std::deque<Job> jobs; // the tasks reference the jobs, the deque keeps them in place
+			uint64 used = 0;
+			uint32 active = 0;
+			uint32 waiting = 0;
+
+			// starts all waiting jobs that fit in the budget, requires the mutex to be locked
+			void dispatch()
+			{
+				const uint64 budget = uint64(configTexturesMemoryBudget) * 1024 * 1024;
+				for (Job &j : jobs)
+				{
+					if (waiting == 0)
+						break;
+					if (j.admitted)
+						continue;
+					if (budget > 0 && active > 0 && used + j.bytes > budget)
+						continue;
+					j.admitted = true;
+					waiting--;
+					used += j.bytes;
+					active++;
+					j.taskRef = tasksRunAsync("chunk textures", Delegate<void(uint32)>().bind<Job, &Job::run>(&j));
+				}
+			}
+
+			void finished(uint64 bytes)
+			{
+				{
+					ScopeLock lock(mutex);
+					CAGE_ASSERT(used >= bytes && active > 0);
+					used -= bytes;
+					active--;
+					dispatch();
+				}
+				cond->broadcast();
+			}
+
+			// chunks are admitted in the order of the schedule, smaller chunks may overtake larger ones that do not fit yet
+			void submit(Delegate<void(uint32)> entry, const ChunksSchedule &schedule)
+			{
+				ScopeLock lock(mutex);
+				for (uint32 task = 0; task < schedule.order.size(); task++)
+				{
+					Job &j = jobs.emplace_back();
+					j.scheduler = this;
+					j.entry = entry;
+					j.task = task;
+					const uint32 r = schedule.resolutions[schedule.order[task]];
+					j.bytes = texturesMemoryEstimate(r, r);
+					waiting++;
+				}
+				dispatch();
+			}
+
+			// must not be called from a task
+			void wait()
+			{
+				{
+					ScopeLock lock(mutex);
+					while (waiting > 0 || active > 0)
+						cond->wait(mutex);
+				}
+				for (Job &j : jobs)
+					j.taskRef->wait(); // rethrows exceptions from the chunks
+				jobs.clear();
+			}
+		} texturesScheduler;
+
 		struct NavmeshProcessor
 		{
+			Holder<Mesh> navmesh;
+
 			Holder<AsyncTask> taskRef;
 
 			void processEntry(uint32)
 			{
-				Holder<Mesh> navmesh = meshGenerateBaseNavigation();
 				if (configDebugSaveIntermediate)
 					meshSaveDebug(navmesh, pathJoin(debugDirectory, "navMeshBase.glb"));
 				Holder<Mesh> collider = navmesh->copy();
@@ -109,34 +232,37 @@ namespace unnatural
 				generateDoodads();
 			}
 
-			NavmeshProcessor() { taskRef = tasksRunAsync("navmesh", Delegate<void(uint32)>().bind<NavmeshProcessor, &NavmeshProcessor::processEntry>(this)); }
+			NavmeshProcessor(Holder<Mesh> &&base) : navmesh(std::move(base)) { taskRef = tasksRunAsync("navmesh", Delegate<void(uint32)>().bind<NavmeshProcessor, &NavmeshProcessor::processEntry>(this)); }
 
 			void wait() { taskRef->wait(); }
 		};
 
 		struct LandProcessor
 		{
+			Holder<Mesh> base;
 			Holder<PointerRange<Holder<Mesh>>> split;
+			ChunksSchedule schedule;
 
 			Holder<AsyncTask> taskRef;
 
-			void chunkEntry(uint32 index)
+			void chunkEntry(uint32 task)
 			{
+				const uint32 index = schedule.order[task];
 				Chunk c;
 				c.mesh = Stringizer() + "land-" + index + ".glb";
 				c.albedo = Stringizer() + "land-" + index + "-albedo.png";
 				c.pbr = Stringizer() + "land-" + index + "-pbr.png";
 				c.normal = Stringizer() + "land-" + index + "-normal.png";
 				const auto &msh = split[index];
-				const uint32 resolution = meshUnwrap(msh);
+				const uint32 resolution = schedule.resolutions[index];
 				meshSaveRender(msh, pathJoin(assetsDirectory, c.mesh), c.transparency);
-				Holder<Image> albedo, special, heightMap;
-				generateTexturesLand(msh, resolution, resolution, albedo, special, heightMap);
-				albedo->exportFile(pathJoin(assetsDirectory, c.albedo));
-				imageConvertSpecialToGltfPbr(+special);
-				special->exportFile(pathJoin(assetsDirectory, c.pbr));
-				imageConvertHeigthToNormal(+heightMap, 1);
-				heightMap->exportFile(pathJoin(assetsDirectory, c.normal));
+				{
+					Holder<Image> albedo, pbr, normal;
+					generateTexturesLand(msh, resolution, resolution, albedo, pbr, normal);
+					albedo->exportFile(pathJoin(assetsDirectory, c.albedo));
+					pbr->exportFile(pathJoin(assetsDirectory, c.pbr));
+					normal->exportFile(pathJoin(assetsDirectory, c.normal));
+				}
 				c.makeCpm();
 				{
 					ScopeLock lock(chunksMutex);
@@ -147,7 +273,7 @@ namespace unnatural
 			void processEntry(uint32)
 			{
 				{
-					Holder<Mesh> mesh = meshGenerateBaseLand();
+					Holder<Mesh> mesh = std::move(base);
 					if (configDebugSaveIntermediate)
 						meshSaveDebug(mesh, pathJoin(debugDirectory, "landMeshBase.glb"));
 					meshSimplifyRender(mesh);
@@ -156,22 +282,26 @@ namespace unnatural
 					split = meshSplit(mesh);
 					CAGE_LOG(SeverityEnum::Info, "generator", Stringizer() + "land mesh split into " + split.size() + " chunks");
 				}
-				tasksRunBlocking("land chunk", Delegate<void(uint32)>().bind<LandProcessor, &LandProcessor::chunkEntry>(this), numeric_cast<uint32>(split.size()));
+				schedule.prepare(split);
+				texturesScheduler.submit(Delegate<void(uint32)>().bind<LandProcessor, &LandProcessor::chunkEntry>(this), schedule);
 			}
 
-			LandProcessor() { taskRef = tasksRunAsync("land", Delegate<void(uint32)>().bind<LandProcessor, &LandProcessor::processEntry>(this)); }
+			LandProcessor(Holder<Mesh> &&base) : base(std::move(base)) { taskRef = tasksRunAsync("land", Delegate<void(uint32)>().bind<LandProcessor, &LandProcessor::processEntry>(this)); }
 
 			void wait() { taskRef->wait(); }
 		};
 
 		struct WaterProcessor
 		{
+			Holder<Mesh> base;
 			Holder<PointerRange<Holder<Mesh>>> split;
+			ChunksSchedule schedule;
 
 			Holder<AsyncTask> taskRef;
 
-			void chunkEntry(uint32 index)
+			void chunkEntry(uint32 task)
 			{
+				const uint32 index = schedule.order[task];
 				Chunk c;
 				c.mesh = Stringizer() + "water-" + index + ".glb";
 				c.albedo = Stringizer() + "water-" + index + "-albedo.png";
@@ -179,15 +309,15 @@ namespace unnatural
 				c.normal = Stringizer() + "water-" + index + "-normal.png";
 				c.transparency = true;
 				const auto &msh = split[index];
-				const uint32 resolution = meshUnwrap(msh);
+				const uint32 resolution = schedule.resolutions[index];
 				meshSaveRender(msh, pathJoin(assetsDirectory, c.mesh), c.transparency);
-				Holder<Image> albedo, special, heightMap;
-				generateTexturesWater(msh, resolution, resolution, albedo, special, heightMap);
-				albedo->exportFile(pathJoin(assetsDirectory, c.albedo));
-				imageConvertSpecialToGltfPbr(+special);
-				special->exportFile(pathJoin(assetsDirectory, c.pbr));
-				imageConvertHeigthToNormal(+heightMap, 1);
-				heightMap->exportFile(pathJoin(assetsDirectory, c.normal));
+				{
+					Holder<Image> albedo, pbr, normal;
+					generateTexturesWater(msh, resolution, resolution, albedo, pbr, normal);
+					albedo->exportFile(pathJoin(assetsDirectory, c.albedo));
+					pbr->exportFile(pathJoin(assetsDirectory, c.pbr));
+					normal->exportFile(pathJoin(assetsDirectory, c.normal));
+				}
 				c.makeCpm();
 				{
 					ScopeLock lock(chunksMutex);
@@ -198,7 +328,7 @@ namespace unnatural
 			void processEntry(uint32)
 			{
 				{
-					Holder<Mesh> mesh = meshGenerateBaseWater();
+					Holder<Mesh> mesh = std::move(base);
 					if (mesh->indicesCount() == 0)
 					{
 						CAGE_LOG(SeverityEnum::Info, "generator", "generated no water");
@@ -212,10 +342,11 @@ namespace unnatural
 					split = meshSplit(mesh);
 					CAGE_LOG(SeverityEnum::Info, "generator", Stringizer() + "water mesh split into " + split.size() + " chunks");
 				}
-				tasksRunBlocking("water chunk", Delegate<void(uint32)>().bind<WaterProcessor, &WaterProcessor::chunkEntry>(this), numeric_cast<uint32>(split.size()));
+				schedule.prepare(split);
+				texturesScheduler.submit(Delegate<void(uint32)>().bind<WaterProcessor, &WaterProcessor::chunkEntry>(this), schedule);
 			}
 
-			WaterProcessor() { taskRef = tasksRunAsync("water", Delegate<void(uint32)>().bind<WaterProcessor, &WaterProcessor::processEntry>(this)); }
+			WaterProcessor(Holder<Mesh> &&base) : base(std::move(base)) { taskRef = tasksRunAsync("water", Delegate<void(uint32)>().bind<WaterProcessor, &WaterProcessor::processEntry>(this)); }
 
 			void wait() { taskRef->wait(); }
 		};
@@ -430,13 +561,17 @@ bpy.ops.object.select_all(action='DESELECT')
 		terrainPreseed();
 
 		{
-			NavmeshProcessor navigation;
-			LandProcessor land;
-			WaterProcessor water;
+			Holder<Mesh> landBase, waterBase, navigationBase;
+			meshGenerateBase(landBase, waterBase, navigationBase);
+			NavmeshProcessor navigation(std::move(navigationBase));
+			LandProcessor land(std::move(landBase));
+			WaterProcessor water(std::move(waterBase));
 			navigation.wait();
 			land.wait();
 			water.wait();
+			texturesScheduler.wait(); // the chunks reference the processors
 		}
+		coloringLogStatistics();
 
 		exportConfiguration();
 
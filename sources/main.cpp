@@ -9,10 +9,16 @@ namespace unnatural
 {
 	void terrainApplyConfig();
 	void generateEntry(const String &overrideOutputPath);
+	void fastMathValidate();
+	void sdfValidate();
+	void sdfExpressionBenchmark();
+	void elevationValidate();
+	void meshValidate();
 
 	namespace
 	{
 		String configOverrideOutputPath;
+		bool configSelfTest = false;
 
 		void applyConfiguration(const Holder<Ini> &cmd)
 		{
@@ -36,6 +42,14 @@ namespace unnatural
 
 			terrainApplyConfig();
 
+			ConfigFloat configBakeFrequency("unnatural-planets/noise/bakeFrequency", 0.003);
+			configBakeFrequency = cmd->cmdFloat('b', "bakeFrequency", configBakeFrequency);
+			CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "bake noises with highest frequency below: " + (float)configBakeFrequency);
+
+			ConfigUint32 configTexturesMemoryBudget("unnatural-planets/textures/memoryBudget", 8192);
+			configTexturesMemoryBudget = cmd->cmdUint32('m', "memoryBudget", configTexturesMemoryBudget);
+			CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "textures memory budget (MB, 0 = unlimited): " + (uint32)configTexturesMemoryBudget);
+
 			ConfigBool configNavmeshOptimize("unnatural-planets/navmesh/optimize", !CAGE_DEBUG_BOOL);
 			configNavmeshOptimize = cmd->cmdBool('o', "optimize", configNavmeshOptimize);
 			CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "enable navmesh optimizations: " + !!configNavmeshOptimize);
@@ -51,6 +65,9 @@ namespace unnatural
 			// configOverrideOutputPath should not be stored in the ini file
 			configOverrideOutputPath = cmd->cmdString('v', "outputPathOverride", "");
 			CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "override output path: " + configOverrideOutputPath);
+
+			// configSelfTest should not be stored in the ini file
+			configSelfTest = cmd->cmdBool('t', "selfTest", false);
 		}
 	}
 }
@@ -72,6 +89,21 @@ int main(int argc, const char *args[])
 			cmd->checkUnusedWithHelp();
 		}
 
+		// the self test validates the approximations, the batch evaluations, the octaves culling and the slab marching cubes, and exits with non-zero code on failure
+		if (configSelfTest || CAGE_DEBUG_BOOL)
+		{
+			fastMathValidate();
+			sdfValidate();
+			elevationValidate();
+			meshValidate();
+		}
+		if (configSelfTest)
+		{
+			sdfExpressionBenchmark();
+			CAGE_LOG(SeverityEnum::Info, "selfTest", "all validations passed");
+			return 0;
+		}
+
 		generateEntry(configOverrideOutputPath);
 		return 0;
 	}
@@ -1,18 +1,27 @@
+#include <algorithm>
+#include <atomic>
+
+#include "fractalNoise.h"
 #include "math.h"
 #include "planets.h"
+#include "sdf.h"
 
 #include <cage-core/config.h>
 #include <cage-core/geometry.h>
 #include <cage-core/marchingCubes.h>
 #include <cage-core/meshAlgorithms.h>
+#include <cage-core/tasks.h>
 #include <unnatural-navmesh/navmesh.h>
 
 namespace unnatural
 {
-	Real terrainSdfElevationRaw(const Vec3 &pos);
-	Real terrainSdfLand(const Vec3 &pos);
+	void terrainSdfElevationRaw(PointerRange<const Vec3> positions, PointerRange<Real> results);
 	Real terrainSdfWater(const Vec3 &pos);
-	Real terrainSdfNavigation(const Vec3 &pos);
+	void terrainSdfWater(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void terrainSdfBase(PointerRange<const Vec3> positions, PointerRange<Real> land, PointerRange<Real> water, PointerRange<Real> navigation, PointerRange<Real> elevation);
+	Real terrainSdfLipschitz();
+	Vec2 terrainSdfElevationRange(MeshPurposeEnum purpose);
+	Vec2 terrainElevationRawRange();
 
 	namespace
 	{
@@ -21,52 +30,790 @@ namespace unnatural
 		constexpr uint32 boxResolution = 110;
 		constexpr uint32 iterations = 1;
 		constexpr float tileSize = 30;
+		constexpr float texelsPerUnit = 0.3;
 #else
 		constexpr uint32 boxResolution = 500;
 		constexpr uint32 iterations = 10;
 		constexpr float tileSize = 10;
+		constexpr float texelsPerUnit = 1.35;
 #endif // CAGE_DEBUG
+		constexpr float voxelSize = boxSize.value / (boxResolution - 1);
+		constexpr Real waterElevation = 0.1; // the water is generated where the raw elevation is below this
 
 		const ConfigBool configNavmeshOptimize("unnatural-planets/navmesh/optimize");
 
-		template<Real (*FNC)(const Vec3 &)>
-		Holder<Mesh> meshGenerateGeneric()
-		{
-			MarchingCubesCreateConfig cfg;
-			cfg.box = Aabb(Vec3(boxSize * -0.5), Vec3(boxSize * 0.5));
-			cfg.resolution = Vec3i(boxResolution);
-			Holder<MarchingCubes> cubes = newMarchingCubes(cfg);
-			cubes->updateByPosition(Delegate<Real(const Vec3 &)>().bind<FNC>());
-			Holder<Mesh> poly = cubes->makeMesh();
-			meshRemoveDisconnected(+poly);
-			meshFlipNormals(+poly);
-			return poly;
+		constexpr MeshPurposeEnum basePurposes[3] = { MeshPurposeEnum::Land, MeshPurposeEnum::Water, MeshPurposeEnum::Navigation };
+
+		// map of blocks that are far from the surfaces, shared by all three base meshes
+		// each field is the shape minus an elevation offset with a known range (see terrainSdfElevationRange)
+		// the grid is evaluated hierarchically, starting with coarse blocks, and the lipschitz bound of the shape bounds its values in the whole block from the value at the center
+		// a block is far from a surface if the field has the same sign for all values of the shape and of the elevation offset
+		// far blocks return a value with the correct sign, and therefore the generated mesh is exactly the same
+		struct FarBlocks
+		{
+			static constexpr uint32 blockVoxels = 4; // finest block size in voxels
+			static constexpr uint32 topBlocks = 8; // coarsest block size in finest blocks
+
+			struct Block
+			{
+				Real far[3] = { Real::Nan(), Real::Nan(), Real::Nan() }; // value of each of the fields in the block, or nan when the block is near the surface
+			};
+
+			std::vector<Block> blocks;
+			const Vec3 origin = Vec3(boxSize * -0.5);
+			const Real blockSize = voxelSize * blockVoxels;
+			const uint32 blocksCount = (boxResolution + blockVoxels - 1) / blockVoxels;
+			const uint32 topCount = (blocksCount + topBlocks - 1) / topBlocks;
+			Real lipschitz;
+			Vec2 offsets[3];
+			bool dry = false; // no water is generated, because the elevation is never below the sea level (see meshTrimWater)
+
+			FarBlocks()
+			{
+				lipschitz = terrainSdfLipschitz();
+				for (uint32 i = 0; i < 3; i++)
+					offsets[i] = terrainSdfElevationRange(basePurposes[i]);
+				dry = terrainElevationRawRange()[0] >= waterElevation;
+				blocks.resize(blocksCount * blocksCount * blocksCount);
+				tasksRunBlocking("far blocks", Delegate<void(uint32)>().bind<FarBlocks, &FarBlocks::topBlock>(this), topCount * topCount * topCount);
+				uint32 far = 0;
+				for (const Block &b : blocks)
+					far += valid(b.far[0]) && valid(b.far[1]) && valid(b.far[2]);
+				CAGE_LOG(SeverityEnum::Info, "generator", Stringizer() + "skipped sampling in " + (100 * Real(far) / blocks.size()) + " % of the volume");
+				if (dry)
+					CAGE_LOG(SeverityEnum::Info, "generator", "skipped water, the elevation is above the sea level everywhere");
+			}
+
+			void topBlock(uint32 index)
+			{
+				const uint32 x = index % topCount;
+				const uint32 y = (index / topCount) % topCount;
+				const uint32 z = index / (topCount * topCount);
+				const Real far[3] = { Real::Nan(), dry ? Real(1) : Real::Nan(), Real::Nan() };
+				const SamplingFootprint footprint(voxelSize);
+				subdivide(x * topBlocks, y * topBlocks, z * topBlocks, topBlocks, far);
+			}
+
+			void subdivide(uint32 bx, uint32 by, uint32 bz, uint32 size, const Real parentFar[3])
+			{
+				if (bx >= blocksCount || by >= blocksCount || bz >= blocksCount)
+					return;
+
+				Real far[3] = { parentFar[0], parentFar[1], parentFar[2] };
+				{
+					const Real half = size * blockSize * 0.5;
+					const Vec3 center = origin + Vec3(bx, by, bz) * blockSize + half;
+					const Real shape = terrainSdfWater(center);
+					// the margin of one voxel diagonal ensures that the cells crossing the block boundary do not change sign either
+					const Real radius = (half + voxelSize) * sqrt(3);
+					const Real lo = shape - lipschitz * radius, hi = shape + lipschitz * radius; // range of the shape in the block
+					for (uint32 i = 0; i < 3; i++)
+					{
+						if (valid(far[i]))
+							continue;
+						if (lo > offsets[i][1])
+							far[i] = shape - offsets[i][1];
+						else if (hi < offsets[i][0])
+							far[i] = shape - offsets[i][0];
+					}
+				}
+
+				if ((valid(far[0]) && valid(far[1]) && valid(far[2])) || size == 1)
+				{
+					const uint32 ex = min(bx + size, blocksCount), ey = min(by + size, blocksCount), ez = min(bz + size, blocksCount);
+					for (uint32 z = bz; z < ez; z++)
+					{
+						for (uint32 y = by; y < ey; y++)
+						{
+							for (uint32 x = bx; x < ex; x++)
+							{
+								Block &b = blocks[(z * blocksCount + y) * blocksCount + x];
+								for (uint32 i = 0; i < 3; i++)
+									b.far[i] = far[i];
+							}
+						}
+					}
+					return;
+				}
+
+				const uint32 s = size / 2;
+				for (uint32 z = 0; z < 2; z++)
+					for (uint32 y = 0; y < 2; y++)
+						for (uint32 x = 0; x < 2; x++)
+							subdivide(bx + x * s, by + y * s, bz + z * s, s, far);
+			}
+
+			const Block &block(uint32 x, uint32 y, uint32 z) const { return blocks[((z / blockVoxels) * blocksCount + y / blockVoxels) * blocksCount + x / blockVoxels]; }
+
+			// finds the range of samples that encloses all surfaces, that is the blocks near any of the surfaces
+			// regions inside the fields are excluded, marching cubes generate no triangles there and the clipping at the box boundary does not close the surfaces
+			// therefore planar shapes are fitted to the band around the surface
+			void fit(uint32 begin[3], uint32 end[3]) const
+			{
+				uint32 lo[3] = { m, m, m }, hi[3] = { 0, 0, 0 };
+				for (uint32 z = 0; z < blocksCount; z++)
+				{
+					for (uint32 y = 0; y < blocksCount; y++)
+					{
+						for (uint32 x = 0; x < blocksCount; x++)
+						{
+							const Block &b = blocks[(z * blocksCount + y) * blocksCount + x];
+							if (valid(b.far[0]) && valid(b.far[1]) && valid(b.far[2]))
+								continue;
+							const uint32 c[3] = { x, y, z };
+							for (uint32 i = 0; i < 3; i++)
+							{
+								lo[i] = min(lo[i], c[i]);
+								hi[i] = max(hi[i], c[i]);
+							}
+						}
+					}
+				}
+				for (uint32 i = 0; i < 3; i++)
+				{
+					if (lo[i] > hi[i])
+					{
+						// no surface at all
+						begin[i] = 0;
+						end[i] = 2;
+						continue;
+					}
+					// one extra sample on each side for cells that cross the block boundary
+					begin[i] = max(lo[i] * blockVoxels, 1u) - 1;
+					end[i] = min((hi[i] + 1) * blockVoxels + 1, boxResolution);
+				}
+			}
+		};
+
+		// marching cubes case table, generated by tracing the surface around the faces of the cube
+		// corners are indexed x + 2 * y + 4 * z and a corner is inside when its value is negative
+		// an edge is indexed by its axis * 4 + the position of its lower corner along the two following axes
+		// the segments on each face cut off the inside corners, which is the same choice from both cubes sharing the face, therefore the mesh is watertight
+		// the triangles are oriented towards positive values
+		struct CasesTable
+		{
+			uint8 count[256] = {}; // number of triangles
+			uint8 edges[256][15] = {};
+			uint8 corners[12][2] = {}; // lower and upper corner of each edge
+
+			static uint32 edgeIndex(uint32 p, uint32 q)
+			{
+				const uint32 d = p ^ q;
+				const uint32 axis = d == 1 ? 0 : d == 2 ? 1 : 2;
+				const uint32 lower = p & q;
+				return axis * 4 + ((lower >> ((axis + 1) % 3)) & 1) + 2 * ((lower >> ((axis + 2) % 3)) & 1);
+			}
+
+			// the two faces that contain the edge, as axis * 2 + side
+			static bool shareFace(uint32 a, uint32 b)
+			{
+				const uint32 fa[2] = { ((a / 4 + 1) % 3) * 2 + (a & 1), ((a / 4 + 2) % 3) * 2 + ((a >> 1) & 1) };
+				const uint32 fb[2] = { ((b / 4 + 1) % 3) * 2 + (b & 1), ((b / 4 + 2) % 3) * 2 + ((b >> 1) & 1) };
+				return fa[0] == fb[0] || fa[0] == fb[1] || fa[1] == fb[0] || fa[1] == fb[1];
+			}
+
+			CasesTable()
+			{
+				for (uint32 e = 0; e < 12; e++)
+				{
+					const uint32 axis = e / 4;
+					const uint32 lower = ((e & 1) << ((axis + 1) % 3)) | (((e >> 1) & 1) << ((axis + 2) % 3));
+					corners[e][0] = lower;
+					corners[e][1] = lower | (1 << axis);
+				}
+
+				for (uint32 c = 0; c < 256; c++)
+				{
+					// segments on the faces, from the crossing into the inside to the crossing out of it
+					uint32 next[12];
+					for (uint32 &n : next)
+						n = m;
+					for (uint32 axis = 0; axis < 3; axis++)
+					{
+						for (uint32 side = 0; side < 2; side++)
+						{
+							// corners of the face counter-clockwise around its outward normal
+							static constexpr uint32 square[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+							uint32 order[4];
+							for (uint32 k = 0; k < 4; k++)
+							{
+								const uint32 *s = square[side ? k : 3 - k];
+								order[k] = (side << axis) | (s[0] << ((axis + 1) % 3)) | (s[1] << ((axis + 2) % 3));
+							}
+							uint32 crossings[4], inwards[4], n = 0;
+							for (uint32 k = 0; k < 4; k++)
+							{
+								const uint32 p = order[k], q = order[(k + 1) % 4];
+								const bool pi = (c >> p) & 1, qi = (c >> q) & 1;
+								if (pi == qi)
+									continue;
+								crossings[n] = edgeIndex(p, q);
+								inwards[n] = qi;
+								n++;
+							}
+							for (uint32 k = 0; k < n; k++)
+							{
+								if (!inwards[k])
+									continue;
+								for (uint32 j = 1; j < n; j++)
+								{
+									const uint32 l = (k + j) % n;
+									if (!inwards[l])
+									{
+										next[crossings[k]] = crossings[l];
+										break;
+									}
+								}
+							}
+						}
+					}
+
+					// chain the segments into loops and triangulate them
+					bool used[12] = {};
+					uint32 cnt = 0;
+					for (uint32 e = 0; e < 12; e++)
+					{
+						if (next[e] == m || used[e])
+							continue;
+						uint32 loop[12];
+						uint32 len = 0;
+						for (uint32 x = e; !used[x]; x = next[x])
+						{
+							used[x] = true;
+							loop[len++] = x;
+						}
+						// the fan must not have a diagonal on a face of the cube, where the neighboring cube has an edge instead
+						uint32 apex = 0;
+						for (uint32 r = 0; r < len; r++)
+						{
+							bool ok = true;
+							for (uint32 i = 2; i + 1 < len; i++)
+								ok = ok && !shareFace(loop[r], loop[(r + i) % len]);
+							if (ok)
+							{
+								apex = r;
+								break;
+							}
+						}
+						for (uint32 i = 1; i + 1 < len; i++)
+						{
+							CAGE_ASSERT(cnt < 5);
+							edges[c][cnt * 3 + 0] = loop[apex];
+							edges[c][cnt * 3 + 1] = loop[(apex + i) % len];
+							edges[c][cnt * 3 + 2] = loop[(apex + i + 1) % len];
+							cnt++;
+						}
+					}
+					count[c] = cnt;
+				}
+			}
+		};
+
+		const CasesTable &casesTable()
+		{
+			static const CasesTable table;
+			return table;
 		}
-	}
 
-	Holder<Mesh> meshGenerateBaseLand()
-	{
-		CAGE_LOG(SeverityEnum::Info, "generator", "generating base land mesh");
-		Holder<Mesh> poly = meshGenerateGeneric<&terrainSdfLand>();
-		if (poly->indicesCount() == 0)
-			CAGE_THROW_ERROR(Exception, "generated empty base land mesh");
-		CAGE_LOG(SeverityEnum::Info, "generator", Stringizer() + "land mesh bounding box: " + poly->boundingBox());
-		return poly;
-	}
+		// coarse mask over the samples of a grid, in cubic blocks
+		struct BlockMask
+		{
+			uint32 voxels = 1;
+			uint32 count[3] = {};
+			std::vector<bool> blocks;
 
-	Holder<Mesh> meshGenerateBaseWater()
-	{
-		CAGE_LOG(SeverityEnum::Info, "generator", "generating base water mesh");
-		Holder<Mesh> poly = meshGenerateGeneric<&terrainSdfWater>();
+			void resize(const uint32 res[3], uint32 blockVoxels)
+			{
+				voxels = blockVoxels;
+				for (uint32 i = 0; i < 3; i++)
+					count[i] = (res[i] + voxels - 1) / voxels;
+				blocks.clear();
+				blocks.resize(count[0] * count[1] * count[2]);
+			}
+
+			uint32 index(uint32 x, uint32 y, uint32 z) const { return ((z / voxels) * count[1] + y / voxels) * count[0] + x / voxels; }
+			bool test(uint32 x, uint32 y, uint32 z) const { return blocks[index(x, y, z)]; }
+		};
+
+		// marching cubes that stream the grid through two sample planes per slab
+		// the slabs are polygonized in parallel, each into its own vertices and triangles, which are appended to the output meshes in order
+		// vertices on the plane shared by two neighboring slabs are generated from the same samples by both slabs and are welded by their edges
+		struct SlabMarchingCubes
+		{
+			static constexpr uint32 slabLayers = 16;
+
+			struct Slab
+			{
+				std::vector<Vec3> positions;
+				std::vector<uint32> indices;
+				std::vector<std::pair<uint32, uint32>> first, last; // vertices on the first and the last sample plane of the slab, keyed by their edge in the plane
+			};
+
+			Vec3 origin;
+			Real spacing;
+			uint32 res[3] = {};
+			bool enabled[3] = {};
+			const BlockMask *skip[3] = {}; // optional, cubes with the lower corner in a set block are not polygonized
+			Delegate<void(uint32, PointerRange<Real>)> sample; // fills one sample plane of all three fields, field after field, rows along x
+			std::vector<Slab> slabs[3];
+			Holder<Mesh> meshes[3];
+
+			// vertices on the edges of one layer of cubes of one field
+			struct Layer
+			{
+				const SlabMarchingCubes *cubes = nullptr;
+				const BlockMask *skip = nullptr;
+				Slab *slab = nullptr;
+				std::vector<uint32> planeEdges[2]; // edges along x and y in the lower and the upper plane
+				std::vector<uint32> verticalEdges;
+				uint32 z0 = 0, z1 = 0; // first and last sample plane of the slab
+				uint32 z = 0; // lower sample plane of the layer
+
+				uint32 vertex(uint32 x, uint32 y, uint32 zz, uint32 axis, Real a, Real b)
+				{
+					const uint32 planeIndex = y * cubes->res[0] + x;
+					uint32 &v = axis == 2 ? verticalEdges[planeIndex] : planeEdges[zz - z][planeIndex * 2 + axis];
+					if (v != m)
+						return v;
+					v = numeric_cast<uint32>(slab->positions.size());
+					Vec3 p = cubes->origin + Vec3(x, y, zz) * cubes->spacing;
+					p[axis] += cubes->spacing * a / (a - b);
+					slab->positions.push_back(p);
+					if (axis < 2 && zz == z0)
+						slab->first.push_back({ planeIndex * 2 + axis, v });
+					if (axis < 2 && zz == z1)
+						slab->last.push_back({ planeIndex * 2 + axis, v });
+					return v;
+				}
+
+				void polygonize(const Real *lower, const Real *upper)
+				{
+					const CasesTable &table = casesTable();
+					const uint32 rx = cubes->res[0];
+					for (uint32 y = 0; y + 1 < cubes->res[1]; y++)
+					{
+						for (uint32 x = 0; x + 1 < rx; x++)
+						{
+							if (skip && skip->test(x, y, z))
+								continue;
+							const Real *rows[4] = { lower + y * rx + x, lower + (y + 1) * rx + x, upper + y * rx + x, upper + (y + 1) * rx + x };
+							Real v[8];
+							uint32 c = 0;
+							for (uint32 i = 0; i < 8; i++)
+							{
+								v[i] = rows[i >> 1][i & 1];
+								if (v[i] < 0)
+									c |= 1 << i;
+							}
+							const uint32 cnt = table.count[c] * 3;
+							for (uint32 k = 0; k < cnt; k++)
+							{
+								const uint32 e = table.edges[c][k];
+								const uint32 lo = table.corners[e][0], hi = table.corners[e][1];
+								slab->indices.push_back(vertex(x + (lo & 1), y + ((lo >> 1) & 1), z + (lo >> 2), e / 4, v[lo], v[hi]));
+							}
+						}
+					}
+				}
+
+				void advance()
+				{
+					std::swap(planeEdges[0], planeEdges[1]);
+					std::fill(planeEdges[1].begin(), planeEdges[1].end(), m);
+					std::fill(verticalEdges.begin(), verticalEdges.end(), m);
+					z++;
+				}
+			};
+
+			uint32 slabsCount() const { return (res[2] - 1 + slabLayers - 1) / slabLayers; }
 
+			void slabEntry(uint32 index)
+			{
+				const uint32 planeSize = res[0] * res[1];
+				const uint32 z0 = index * slabLayers;
+				const uint32 z1 = min(z0 + slabLayers, res[2] - 1);
+				std::vector<Real> planes[2];
+				for (auto &it : planes)
+					it.resize(planeSize * 3);
+				Layer layers[3];
+				for (uint32 i = 0; i < 3; i++)
+				{
+					if (!enabled[i])
+						continue;
+					Layer &l = layers[i];
+					l.cubes = this;
+					l.skip = skip[i];
+					l.slab = &slabs[i][index];
+					for (auto &it : l.planeEdges)
+						it.resize(planeSize * 2, m);
+					l.verticalEdges.resize(planeSize, m);
+					l.z0 = l.z = z0;
+					l.z1 = z1;
+				}
+				sample(z0, planes[0]);
+				for (uint32 z = z0; z < z1; z++)
+				{
+					sample(z + 1, planes[1]);
+					for (uint32 i = 0; i < 3; i++)
+					{
+						if (!enabled[i])
+							continue;
+						layers[i].polygonize(planes[0].data() + i * planeSize, planes[1].data() + i * planeSize);
+						layers[i].advance();
+					}
+					std::swap(planes[0], planes[1]);
+				}
+			}
+
+			void meshEntry(uint32 index)
+			{
+				meshes[index] = newMesh();
+				if (!enabled[index])
+					return;
+				std::vector<Vec3> positions;
+				std::vector<uint32> indices;
+				std::vector<std::pair<uint32, uint32>> previous; // the last plane of the previous slab, with indices into the output
+				for (Slab &s : slabs[index])
+				{
+					std::vector<uint32> remap;
+					remap.resize(s.positions.size(), m);
+					std::sort(s.first.begin(), s.first.end());
+					for (const auto &it : s.first)
+					{
+						const auto w = std::lower_bound(previous.begin(), previous.end(), std::pair<uint32, uint32>(it.first, 0));
+						if (w != previous.end() && w->first == it.first)
+							remap[it.second] = w->second; // otherwise the cubes of the previous slab around the edge were skipped
+					}
+					for (uint32 i = 0; i < remap.size(); i++)
+					{
+						if (remap[i] == m)
+						{
+							remap[i] = numeric_cast<uint32>(positions.size());
+							positions.push_back(s.positions[i]);
+						}
+					}
+					for (uint32 i : s.indices)
+						indices.push_back(remap[i]);
+					previous.clear();
+					for (const auto &it : s.last)
+						previous.push_back({ it.first, remap[it.second] });
+					std::sort(previous.begin(), previous.end());
+					s = Slab(); // release the memory early
+				}
+
+				// area weighted normals
+				std::vector<Vec3> normals;
+				normals.resize(positions.size());
+				for (uint32 t = 0; t < indices.size(); t += 3)
+				{
+					const Vec3 n = cross(positions[indices[t + 1]] - positions[indices[t]], positions[indices[t + 2]] - positions[indices[t]]);
+					for (uint32 i = 0; i < 3; i++)
+						normals[indices[t + i]] += n;
+				}
+				for (Vec3 &n : normals)
+					n = lengthSquared(n) > 0 ? normalize(n) : Vec3(0, 0, 1);
+
+				Holder<Mesh> &poly = meshes[index];
+				poly->positions(positions);
+				poly->normals(normals);
+				poly->indices(indices);
+			}
+
+			void run()
+			{
+				CAGE_ASSERT(res[0] >= 2 && res[1] >= 2 && res[2] >= 2);
+				for (uint32 i = 0; i < 3; i++)
+					if (enabled[i])
+						slabs[i].resize(slabsCount());
+				tasksRunBlocking("marching cubes slab", Delegate<void(uint32)>().bind<SlabMarchingCubes, &SlabMarchingCubes::slabEntry>(this), slabsCount());
+				tasksRunBlocking("marching cubes mesh", Delegate<void(uint32)>().bind<SlabMarchingCubes, &SlabMarchingCubes::meshEntry>(this), 3);
+			}
+		};
+
+		// the three base meshes are generated by marching cubes on a grid fitted to the region containing the surfaces
+		// the target voxel size is the voxel size of the whole box, and the resolution of each axis follows from the fitted extent
+		// the grid is streamed through the slab marching cubes, and each row of samples is evaluated for all fields at once
+		// the land and navigation pass also records which blocks of the grid have any raw elevation below the sea level
+		// the water is marched in a second pass, only in these blocks and their neighbors, and meshTrimWater then trims this band exactly
+		struct BaseMeshesGenerator
+		{
+			static constexpr uint32 maskVoxels = 4;
+			static_assert(SlabMarchingCubes::slabLayers % maskVoxels == 0);
+
+			FarBlocks far;
+			Vec3 gridOrigin;
+			uint32 begin[3] = {}; // first sample of the fitted grid, in samples of the whole box
+			uint32 res[3] = {}; // samples count of the fitted grid
+			std::vector<std::atomic<bool>> wet; // blocks of the mask with any sample below the sea level, shared planes of slabs are sampled by two threads
+			BlockMask dry; // blocks without any wet block in their neighborhood, the water is not marched there
+			Holder<Mesh> meshes[3];
+
+			struct Buffers
+			{
+				std::vector<Vec3> positions;
+				std::vector<Real> fields[4]; // land, water, navigation, raw elevation
+			};
+
+			bool near(const FarBlocks::Block &b) const { return !valid(b.far[0]) || !valid(b.far[1]) || !valid(b.far[2]); }
+
+			// the buffers are reused for all rows of the slab
+			void sampleRow(uint32 y, uint32 z, Buffers &buffers, PointerRange<Real> plane)
+			{
+				const uint32 gy = begin[1] + y, gz = begin[2] + z;
+				const uint32 planeSize = res[0] * res[1];
+
+				// evaluate all samples in the row, which are not in far blocks, at once
+				std::vector<Vec3> &positions = buffers.positions;
+				positions.clear();
+				for (uint32 x = 0; x < res[0]; x++)
+				{
+					const uint32 gx = begin[0] + x;
+					if (near(far.block(gx, gy, gz)))
+						positions.push_back(far.origin + Vec3(gx, gy, gz) * voxelSize);
+				}
+				for (auto &it : buffers.fields)
+					it.resize(positions.size());
+				terrainSdfBase(positions, buffers.fields[0], buffers.fields[1], buffers.fields[2], buffers.fields[3]);
+
+				uint32 j = 0;
+				for (uint32 x = 0; x < res[0]; x++)
+				{
+					const FarBlocks::Block &b = far.block(begin[0] + x, gy, gz);
+					for (uint32 i : { 0, 2 })
+						plane[i * planeSize + y * res[0] + x] = valid(b.far[i]) ? b.far[i] : buffers.fields[i][j];
+					if (near(b))
+					{
+						if (buffers.fields[3][j] < waterElevation)
+						{
+							std::atomic<bool> &w = wet[dry.index(x, y, z)];
+							if (!w.load(std::memory_order_relaxed))
+								w.store(true, std::memory_order_relaxed);
+						}
+						j++;
+					}
+				}
+				CAGE_ASSERT(j == positions.size());
+			}
+
+			void samplePlane(uint32 z, PointerRange<Real> plane)
+			{
+				const SamplingFootprint footprint(voxelSize);
+				thread_local Buffers buffers;
+				for (uint32 y = 0; y < res[1]; y++)
+					sampleRow(y, z, buffers, plane);
+			}
+
+			// a sample is needed by the cubes with the lower corner at the sample or one sample lower along any of the axes
+			bool waterNeeded(uint32 x, uint32 y, uint32 z) const
+			{
+				for (uint32 dz = 0; dz < 2; dz++)
+					for (uint32 dy = 0; dy < 2; dy++)
+						for (uint32 dx = 0; dx < 2; dx++)
+							if (x >= dx && y >= dy && z >= dz && !dry.test(x - dx, y - dy, z - dz))
+								return true;
+				return false;
+			}
+
+			void sampleWaterRow(uint32 y, uint32 z, Buffers &buffers, PointerRange<Real> plane) const
+			{
+				const uint32 gy = begin[1] + y, gz = begin[2] + z;
+				const uint32 planeSize = res[0] * res[1];
+
+				std::vector<Vec3> &positions = buffers.positions;
+				positions.clear();
+				for (uint32 x = 0; x < res[0]; x++)
+				{
+					const uint32 gx = begin[0] + x;
+					if (!valid(far.block(gx, gy, gz).far[1]) && waterNeeded(x, y, z))
+						positions.push_back(far.origin + Vec3(gx, gy, gz) * voxelSize);
+				}
+				buffers.fields[1].resize(positions.size());
+				terrainSdfWater(positions, buffers.fields[1]);
+
+				uint32 j = 0;
+				for (uint32 x = 0; x < res[0]; x++)
+				{
+					const FarBlocks::Block &b = far.block(begin[0] + x, gy, gz);
+					Real &v = plane[planeSize + y * res[0] + x];
+					if (valid(b.far[1]))
+						v = b.far[1];
+					else if (waterNeeded(x, y, z))
+						v = buffers.fields[1][j++];
+					else
+						v = 1; // not read by any polygonized cube
+				}
+				CAGE_ASSERT(j == positions.size());
+			}
+
+			void sampleWaterPlane(uint32 z, PointerRange<Real> plane)
+			{
+				const SamplingFootprint footprint(voxelSize);
+				thread_local Buffers buffers;
+				for (uint32 y = 0; y < res[1]; y++)
+					sampleWaterRow(y, z, buffers, plane);
+			}
+
+			// dilates the wet blocks by one block
+			void buildDryMask()
+			{
+				const uint32 *cnt = dry.count;
+				uint32 dryCount = 0;
+				for (uint32 z = 0; z < cnt[2]; z++)
+				{
+					for (uint32 y = 0; y < cnt[1]; y++)
+					{
+						for (uint32 x = 0; x < cnt[0]; x++)
+						{
+							bool d = true;
+							for (uint32 k = max(z, 1u) - 1; k < min(z + 2, cnt[2]) && d; k++)
+								for (uint32 j = max(y, 1u) - 1; j < min(y + 2, cnt[1]) && d; j++)
+									for (uint32 i = max(x, 1u) - 1; i < min(x + 2, cnt[0]) && d; i++)
+										d = !wet[(k * cnt[1] + j) * cnt[0] + i].load(std::memory_order_relaxed);
+							dry.blocks[(z * cnt[1] + y) * cnt[0] + x] = d;
+							dryCount += d;
+						}
+					}
+				}
+				CAGE_LOG(SeverityEnum::Info, "generator", Stringizer() + "skipped water in " + (100 * Real(dryCount) / dry.blocks.size()) + " % of the volume");
+			}
+
+			BaseMeshesGenerator()
+			{
+				uint32 end[3];
+				far.fit(begin, end);
+				for (uint32 i = 0; i < 3; i++)
+					res[i] = end[i] - begin[i];
+				CAGE_LOG(SeverityEnum::Info, "generator", Stringizer() + "fitted grid resolution: " + res[0] + "x" + res[1] + "x" + res[2] + " (" + (100 * Real(res[0]) * res[1] * res[2] / (Real(boxResolution) * boxResolution * boxResolution)) + " % of the box)");
+				gridOrigin = far.origin + Vec3(begin[0], begin[1], begin[2]) * voxelSize;
+				dry.resize(res, maskVoxels);
+				wet = std::vector<std::atomic<bool>>(dry.blocks.size());
+
+				const auto &cubesConfig = [&](SlabMarchingCubes &cubes)
+				{
+					cubes.origin = gridOrigin;
+					cubes.spacing = voxelSize;
+					for (uint32 i = 0; i < 3; i++)
+						cubes.res[i] = res[i];
+				};
+
+				{ // land and navigation
+					SlabMarchingCubes cubes;
+					cubesConfig(cubes);
+					cubes.enabled[0] = cubes.enabled[2] = true;
+					cubes.sample.bind<BaseMeshesGenerator, &BaseMeshesGenerator::samplePlane>(this);
+					cubes.run();
+					meshes[0] = std::move(cubes.meshes[0]);
+					meshes[2] = std::move(cubes.meshes[2]);
+				}
+
+				if (far.dry)
+					meshes[1] = newMesh();
+				else
+				{ // water
+					buildDryMask();
+					SlabMarchingCubes cubes;
+					cubesConfig(cubes);
+					cubes.enabled[1] = true;
+					cubes.skip[1] = &dry;
+					cubes.sample.bind<BaseMeshesGenerator, &BaseMeshesGenerator::sampleWaterPlane>(this);
+					cubes.run();
+					meshes[1] = std::move(cubes.meshes[1]);
+				}
+
+				// the water band consists of separate patches, which are trimmed instead
+				for (uint32 i : { 0, 2 })
+					if (meshes[i]->indicesCount())
+						meshRemoveDisconnected(+meshes[i]);
+			}
+		};
+
+		// every directed edge has exactly one opposite edge
+		bool closedMesh(const Mesh *poly)
+		{
+			const auto inds = poly->indices();
+			std::vector<std::pair<uint32, uint32>> edges;
+			edges.reserve(inds.size());
+			for (uint32 t = 0; t < inds.size(); t += 3)
+				for (uint32 i = 0; i < 3; i++)
+					edges.push_back({ inds[t + i], inds[t + (i + 1) % 3] });
+			std::sort(edges.begin(), edges.end());
+			if (std::adjacent_find(edges.begin(), edges.end()) != edges.end())
+				return false;
+			for (const auto &e : edges)
+				if (!std::binary_search(edges.begin(), edges.end(), std::pair<uint32, uint32>(e.second, e.first)))
+					return false;
+			return true;
+		}
+
+		Real signedVolume(const Mesh *poly)
+		{
+			const auto pos = poly->positions();
+			const auto inds = poly->indices();
+			Real sum = 0;
+			for (uint32 t = 0; t < inds.size(); t += 3)
+				sum += dot(pos[inds[t]], cross(pos[inds[t + 1]], pos[inds[t + 2]]));
+			return sum / 6;
+		}
+
+		// largest distance of a vertex of one mesh to the surface of the other mesh
+		// the triangles are bucketed in a grid with the cell size of the given radius, which bounds the search
+		Real oneSidedHausdorff(const Mesh *from, const Mesh *to, Real radius)
+		{
+			const auto pos = to->positions();
+			const auto inds = to->indices();
+			const Aabb box = to->boundingBox() + from->boundingBox();
+			const Vec3 origin = box.a - radius;
+			const Vec3 extent = (box.b + radius - origin) / radius;
+			const uint32 side[3] = { numeric_cast<uint32>(ceil(extent[0])), numeric_cast<uint32>(ceil(extent[1])), numeric_cast<uint32>(ceil(extent[2])) };
+			const auto &cell = [&](const Vec3 &p, uint32 c[3])
+			{
+				for (uint32 i = 0; i < 3; i++)
+					c[i] = min(numeric_cast<uint32>(max(floor((p[i] - origin[i]) / radius), Real(0))), side[i] - 1);
+			};
+			std::vector<std::vector<uint32>> buckets;
+			buckets.resize(side[0] * side[1] * side[2]);
+			for (uint32 t = 0; t < inds.size(); t += 3)
+			{
+				const Vec3 &p0 = pos[inds[t]], &p1 = pos[inds[t + 1]], &p2 = pos[inds[t + 2]];
+				uint32 lo[3], hi[3];
+				cell(min(min(p0, p1), p2), lo);
+				cell(max(max(p0, p1), p2), hi);
+				for (uint32 z = lo[2]; z <= hi[2]; z++)
+					for (uint32 y = lo[1]; y <= hi[1]; y++)
+						for (uint32 x = lo[0]; x <= hi[0]; x++)
+							buckets[(z * side[1] + y) * side[0] + x].push_back(t);
+			}
+			Real result = 0;
+			for (const Vec3 &p : from->positions())
+			{
+				uint32 c[3];
+				cell(p, c);
+				Real best = Real::Infinity();
+				for (uint32 z = max(c[2], 1u) - 1; z < min(c[2] + 2, side[2]); z++)
+					for (uint32 y = max(c[1], 1u) - 1; y < min(c[1] + 2, side[1]); y++)
+						for (uint32 x = max(c[0], 1u) - 1; x < min(c[0] + 2, side[0]); x++)
+							for (uint32 t : buckets[(z * side[1] + y) * side[0] + x])
+								best = min(best, distance(p, Triangle(pos[inds[t]], pos[inds[t + 1]], pos[inds[t + 2]])));
+				result = max(result, best); // infinity if no triangle is within the radius
+			}
+			return result;
+		}
+
+		void meshTrimWater(Holder<Mesh> &poly)
 		{
 			meshConvertToIndexed(+poly);
 
 			// check which vertices are needed
 			std::vector<bool> valid;
-			valid.reserve(poly->verticesCount());
-			for (const Vec3 &p : poly->positions())
-				valid.push_back(terrainSdfElevationRaw(p) < 0.1);
+			{
+				const SamplingFootprint footprint(voxelSize); // the vertices are spaced by voxels
+				std::vector<Real> elevs;
+				elevs.resize(poly->verticesCount());
+				terrainSdfElevationRaw(poly->positions(), elevs);
+				valid.reserve(elevs.size());
+				for (Real e : elevs)
+					valid.push_back(e < waterElevation);
+			}
 
 			// expand valid vertices to whole triangles and their neighbors
 			for (uint32 j = 0; j < 2; j++)
@@ -93,17 +840,25 @@ namespace unnatural
 
 			meshRemoveInvalid(+poly);
 		}
-
-		return poly;
 	}
 
-	Holder<Mesh> meshGenerateBaseNavigation()
+	void meshGenerateBase(Holder<Mesh> &land, Holder<Mesh> &water, Holder<Mesh> &navigation)
 	{
-		CAGE_LOG(SeverityEnum::Info, "generator", "generating base navigation mesh");
-		Holder<Mesh> poly = meshGenerateGeneric<&terrainSdfNavigation>();
-		if (poly->indicesCount() == 0)
+		CAGE_LOG(SeverityEnum::Info, "generator", "generating base meshes");
+
+		{
+			BaseMeshesGenerator gen;
+			land = std::move(gen.meshes[0]);
+			water = std::move(gen.meshes[1]);
+			navigation = std::move(gen.meshes[2]);
+		}
+
+		if (land->indicesCount() == 0)
+			CAGE_THROW_ERROR(Exception, "generated empty base land mesh");
+		CAGE_LOG(SeverityEnum::Info, "generator", Stringizer() + "land mesh bounding box: " + land->boundingBox());
+		if (navigation->indicesCount() == 0)
 			CAGE_THROW_ERROR(Exception, "generated empty base navigation mesh");
-		return poly;
+		meshTrimWater(water);
 	}
 
 	void meshSimplifyCollider(Holder<Mesh> &mesh)
@@ -187,15 +942,26 @@ namespace unnatural
 		cfg.maxChartIterations = 10;
 		cfg.maxChartBoundaryLength = 300;
 		cfg.chartRoundness = 0.3;
-#ifdef CAGE_DEBUG
-		cfg.texelsPerUnit = 0.3;
-#else
-		cfg.texelsPerUnit = 1.35;
-#endif // CAGE_DEBUG
+		cfg.texelsPerUnit = texelsPerUnit;
 		cfg.padding = 6;
 		return meshUnwrap(+mesh, cfg);
 	}
 
+	Real meshVoxelSize()
+	{
+		return voxelSize;
+	}
+
+	Real meshTexelSize()
+	{
+		return 1 / texelsPerUnit;
+	}
+
+	Real meshTileSize()
+	{
+		return tileSize;
+	}
+
 	void previewMeshAddPoint(Mesh *msh, Vec3 pos, Vec3 up, Real height)
 	{
 		const Vec3 s = anyPerpendicular(up);
@@ -208,4 +974,84 @@ namespace unnatural
 		msh->addTriangle(Triangle(pos, c, a));
 		msh->addTriangle(Triangle(a, c, b));
 	}
+
+	void meshValidate()
+	{
+		// the slab marching cubes are compared with the marching cubes of the engine on closed shapes
+		// the grid has several slabs, therefore the welding of the seams is exercised as well
+		static constexpr uint32 Resolution = 48;
+		static constexpr Real Extent = 1600;
+		const Real spacing = Extent * 2 / (Resolution - 1);
+
+		struct Shape
+		{
+			const char *name;
+			Real (*fnc)(const Vec3 &);
+			Real spacing;
+
+			Real value(const Vec3 &p) { return fnc(p); }
+
+			// only the first field is enabled
+			void plane(uint32 z, PointerRange<Real> values)
+			{
+				for (uint32 y = 0; y < Resolution; y++)
+					for (uint32 x = 0; x < Resolution; x++)
+						values[y * Resolution + x] = fnc(Vec3(x, y, z) * spacing - Extent);
+			}
+		};
+
+		const auto &fail = [](const Shape &shape, const String &what)
+		{
+			CAGE_LOG_THROW(Stringizer() + "shape: " + shape.name + ", " + what);
+			CAGE_THROW_ERROR(Exception, "slab marching cubes differ from the engine marching cubes");
+		};
+
+		for (Shape shape : { Shape{ "sphere", &sdfSphere, spacing }, Shape{ "torus", &sdfTorus, spacing }, Shape{ "cube", &sdfCube, spacing } })
+		{
+			Holder<Mesh> reference;
+			{
+				MarchingCubesCreateConfig cfg;
+				cfg.box = Aabb(Vec3(-Extent), Vec3(Extent));
+				cfg.resolution = Vec3i(Resolution);
+				Holder<MarchingCubes> cubes = newMarchingCubes(cfg);
+				cubes->updateByPosition(Delegate<Real(const Vec3 &)>().bind<Shape, &Shape::value>(&shape));
+				reference = cubes->makeMesh();
+				meshFlipNormals(+reference);
+				meshConvertToIndexed(+reference);
+			}
+			Holder<Mesh> slabbed;
+			{
+				SlabMarchingCubes cubes;
+				cubes.origin = Vec3(-Extent);
+				cubes.spacing = spacing;
+				for (uint32 i = 0; i < 3; i++)
+					cubes.res[i] = Resolution;
+				cubes.enabled[0] = true;
+				cubes.sample.bind<Shape, &Shape::plane>(&shape);
+				cubes.run();
+				slabbed = std::move(cubes.meshes[0]);
+			}
+
+			// the mesh is closed and consistently oriented, including the seams between slabs
+			if (!closedMesh(+slabbed))
+				fail(shape, "the mesh is not watertight");
+
+			// the counts of vertices and triangles of a closed surface follow from the number of crossed grid edges, whichever variant of marching cubes
+			const auto &similar = [](Real a, Real b) { return abs(a - b) <= 0.05 * max(a, b); };
+			if (!similar(slabbed->verticesCount(), reference->verticesCount()) || !similar(slabbed->facesCount(), reference->facesCount()))
+				fail(shape, Stringizer() + "vertices: " + slabbed->verticesCount() + " (engine: " + reference->verticesCount() + "), triangles: " + slabbed->facesCount() + " (engine: " + reference->facesCount() + ")");
+
+			// same orientation and enclosed volume
+			const Real volume = signedVolume(+slabbed), referenceVolume = signedVolume(+reference);
+			if (volume <= 0 || !similar(volume, referenceVolume))
+				fail(shape, Stringizer() + "volume: " + volume + " (engine: " + referenceVolume + ")");
+
+			// both surfaces interpolate the same samples, therefore they are within a voxel of each other
+			const Real hausdorff = max(oneSidedHausdorff(+slabbed, +reference, spacing), oneSidedHausdorff(+reference, +slabbed, spacing));
+			if (hausdorff > spacing)
+				fail(shape, Stringizer() + "hausdorff distance: " + hausdorff + ", voxel: " + spacing);
+
+			CAGE_LOG(SeverityEnum::Info, "selfTest", Stringizer() + "slab marching cubes: " + shape.name + ", triangles: " + slabbed->facesCount() + " (engine: " + reference->facesCount() + "), hausdorff distance: " + (hausdorff / spacing) + " voxels");
+		}
+	}
 }
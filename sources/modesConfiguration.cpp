@@ -13,10 +13,17 @@ namespace unnatural
 	Real elevationLakes(const Vec3 &);
 	Real elevationIslands(const Vec3 &);
 	Real elevationCraters(const Vec3 &);
-
-	void coloringDefault(Tile &tile);
-	void coloringBarren(Tile &tile);
-	void coloringDebug(Tile &tile);
+	void elevationNone(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void elevationSimple(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void elevationLegacy(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void elevationLakes(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void elevationIslands(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void elevationCraters(PointerRange<const Vec3> positions, PointerRange<Real> results);
+
+	void coloringDefault(PointerRange<Tile> tiles);
+	void coloringBarren(PointerRange<Tile> tiles);
+	void coloringDebug(PointerRange<Tile> tiles);
+	void coloringClimate(PointerRange<Tile> tiles);
 
 	namespace
 	{
@@ -29,9 +36,21 @@ namespace unnatural
 		using TerrainFunctor = Real (*)(const Vec3 &);
 		TerrainFunctor terrainElevationFnc = 0;
 		TerrainFunctor terrainShapeFnc = 0;
+		using TerrainGradientFunctor = Vec3 (*)(const Vec3 &);
+		TerrainGradientFunctor terrainShapeGradientFnc = 0;
+
+		using TerrainBatchFunctor = void (*)(PointerRange<const Vec3> positions, PointerRange<Real> results);
+		TerrainBatchFunctor terrainElevationBatchFnc = 0;
+		TerrainBatchFunctor terrainShapeBatchFnc = 0;
+
+		Real terrainShapeLipschitz = Real::Infinity();
+		Vec2 terrainElevationRange = Vec2(-Real::Infinity(), Real::Infinity());
+
+		constexpr Real meshElevationRatio = 10;
 
-		using ColoringFunctor = void (*)(Tile &tile);
+		using ColoringFunctor = void (*)(PointerRange<Tile> tiles);
 		ColoringFunctor coloringFnc = 0;
+		ColoringFunctor climateFnc = 0; // null when the coloring mode has no climate
 
 		bool doubleSided = false;
 
@@ -76,6 +95,43 @@ namespace unnatural
 
 			static constexpr uint32 shapeModesCount = sizeof(shapeModeFunctions) / sizeof(shapeModeFunctions[0]);
 
+			static constexpr TerrainBatchFunctor shapeModeBatchFunctions[] = {
+				&sdfAsteroid,
+				&sdfBelt,
+				&sdfBowl,
+				&sdfBox,
+				&sdfBunny,
+				&sdfCapsule,
+				&sdfCube,
+				&sdfDisk,
+				&sdfDoubleTorus,
+				&sdfFibers,
+				&sdfGear,
+				&sdfH2O,
+				&sdfH3O,
+				&sdfH4O,
+				&sdfHemispheres,
+				&sdfHexagon,
+				&sdfHexagonalPrism,
+				&sdfInsideCube,
+				&sdfKnot,
+				&sdfMandelbulb,
+				&sdfMobiusStrip,
+				&sdfMonkeyHead,
+				&sdfOctahedron,
+				&sdfPipe,
+				&sdfSphere,
+				&sdfSquare,
+				&sdfTetrahedron,
+				&sdfTorus,
+				&sdfTorusCross,
+				&sdfTriangularPrism,
+				&sdfTube,
+				&sdfTwistedHexagonalPrism,
+				&sdfTwistedPlane,
+				&sdfWormhole,
+			};
+
 			static constexpr const char *const shapeModeNames[] = {
 				"asteroid",
 				"belt",
@@ -115,19 +171,125 @@ namespace unnatural
 
 			static_assert(shapeModesCount == sizeof(shapeModeNames) / sizeof(shapeModeNames[0]), "number of functions and names must match");
 
+			static_assert(shapeModesCount == sizeof(shapeModeBatchFunctions) / sizeof(shapeModeBatchFunctions[0]), "number of functions and batch functions must match");
+
+			// upper bound of the gradient magnitude of the shape function, within the meshing box
+			// infinity disables skipping of empty space for shapes with discontinuities or without a known bound
+			static constexpr Real shapeModeLipschitz[] = {
+				Real::Infinity(), // asteroid: the noise on the direction has tangential gradient 600 * |noise'| / length, unbounded near the center
+				Real::Infinity(), // belt: discontinuous at x = 0
+				1, // bowl: exact distance to a sphere
+				1, // box: exact distance
+				Real::Infinity(), // bunny: discontinuous on the unit sphere of the network, which switches to length(p) - 0.8
+				1, // capsule: exact distance
+				1, // cube: exact distance
+				1, // disk: exact distance
+				1, // doubletorus: smoothMin is a convex combination of the gradients of two exact distances
+				3, // fibers: the gyroid gradient is at most 2 * sqrt(3) in its space, which maps to 2.43, plus 0.5 for the outer falloff
+				1, // gear: min, max and smoothMax of exact distances, and the sectors are mirror symmetric, so the value is continuous across them
+				1, // h2o: smoothMin of exact distances, the scale cancels out
+				1, // h3o: same as h2o
+				1, // h4o: same as h2o
+				1, // hemispheres: mirroring, min and smoothMin of exact distances
+				1, // hexagon: exact distance to a plane
+				1, // hexagonalprism: exact distance
+				1, // insidecube: exact distance
+				Real::Infinity(), // knot: approximate distance without a known bound
+				Real::Infinity(), // mandelbulb: distance estimate, discontinuous where the escape iteration changes
+				Real::Infinity(), // mobiusstrip: the half angle rotation has gradient length / (2 * radius), unbounded near the axis
+				Real::Infinity(), // monkeyhead: same as bunny
+				1, // octahedron: exact distance
+				Real::Infinity(), // pipe: discontinuous at x = 0, where the axes are swapped
+				1, // sphere: exact distance
+				1, // square: exact distance to a plane
+				1, // tetrahedron: exact distance
+				1, // torus: exact distance
+				1, // toruscross: same as doubletorus
+				1, // triangularprism: exact distance
+				1, // tube: exact distance
+				4, // twistedhexagonalprism: the twist of 0.001 rad per meter adds at most 3 at distance 3000 from the axis, which covers the box, and the jacobian norm is sqrt(1 + 1 + 3^2)
+				4, // twistedplane: the angle changes by at most 0.0012 rad per meter along z, which adds 3.7 at distance 3000 from the axis, and sqrt(1 + 3.7^2) is 3.8
+				1, // wormhole: min and length of terms with unit gradients
+			};
+
+			static_assert(shapeModesCount == sizeof(shapeModeLipschitz) / sizeof(shapeModeLipschitz[0]), "number of functions and lipschitz bounds must match");
+
+			// analytic gradients of the shape functions
+			// null falls back to central differences
+			static constexpr TerrainGradientFunctor shapeModeGradients[] = {
+				nullptr, // asteroid
+				nullptr, // belt
+				&sdfBowlGradient, // bowl
+				&sdfBoxGradient, // box
+				nullptr, // bunny
+				&sdfCapsuleGradient, // capsule
+				&sdfCubeGradient, // cube
+				&sdfDiskGradient, // disk
+				nullptr, // doubletorus
+				nullptr, // fibers
+				nullptr, // gear
+				nullptr, // h2o
+				nullptr, // h3o
+				nullptr, // h4o
+				nullptr, // hemispheres
+				&sdfHexagonGradient, // hexagon
+				nullptr, // hexagonalprism
+				nullptr, // insidecube
+				nullptr, // knot
+				nullptr, // mandelbulb
+				nullptr, // mobiusstrip
+				nullptr, // monkeyhead
+				&sdfOctahedronGradient, // octahedron
+				nullptr, // pipe
+				&sdfSphereGradient, // sphere
+				&sdfSquareGradient, // square
+				&sdfTetrahedronGradient, // tetrahedron
+				&sdfTorusGradient, // torus
+				nullptr, // toruscross
+				&sdfTriangularPrismGradient, // triangularprism
+				&sdfTubeGradient, // tube
+				nullptr, // twistedhexagonalprism
+				nullptr, // twistedplane
+				&sdfWormholeGradient, // wormhole
+			};
+
+			static_assert(shapeModesCount == sizeof(shapeModeGradients) / sizeof(shapeModeGradients[0]), "number of functions and gradients must match");
+
 			String name = configShapeMode;
 			if (name == "random")
 			{
 				const uint32 i = randomRange(0u, shapeModesCount);
 				terrainShapeFnc = shapeModeFunctions[i];
+				terrainShapeBatchFnc = shapeModeBatchFunctions[i];
+				terrainShapeLipschitz = shapeModeLipschitz[i];
+				terrainShapeGradientFnc = shapeModeGradients[i];
 				configShapeMode = name = shapeModeNames[i];
 				CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "randomly chosen shape mode: '" + name + "'");
 			}
+			else if (isPattern(name, "", "", ".sdf"))
+			{
+				const String path = pathIsFile(name) ? name : pathJoin(pathSearchTowardsRoot("shapes", PathTypeFlags::Directory), name);
+				sdfExpressionLoad(path);
+				terrainShapeFnc = &sdfExpression;
+				terrainShapeBatchFnc = &sdfExpression;
+				terrainShapeLipschitz = sdfExpressionLipschitz();
+				terrainShapeGradientFnc = nullptr;
+				doubleSided = sdfExpressionDoubleSided();
+				CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "using shape expression: '" + name + "'");
+				return;
+			}
 			else
 			{
 				for (uint32 i = 0; i < shapeModesCount; i++)
+				{
 					if (name == shapeModeNames[i])
+					{
 						terrainShapeFnc = shapeModeFunctions[i];
+						terrainShapeBatchFnc = shapeModeBatchFunctions[i];
+						terrainShapeLipschitz = shapeModeLipschitz[i];
+						terrainShapeGradientFnc = shapeModeGradients[i];
+					}
+				}
 				if (!terrainShapeFnc)
 				{
 					CAGE_LOG_THROW(Stringizer() + "shape mode: '" + name + "'");
@@ -173,6 +335,15 @@ namespace unnatural
 
 			constexpr uint32 elevationModesCount = sizeof(elevationModeFunctions) / sizeof(elevationModeFunctions[0]);
 
+			constexpr TerrainBatchFunctor elevationModeBatchFunctions[] = {
+				&elevationNone,
+				&elevationSimple,
+				&elevationLegacy,
+				&elevationLakes,
+				&elevationIslands,
+				&elevationCraters,
+			};
+
 			constexpr const char *const elevationModeNames[] = {
 				"none",
 				"simple",
@@ -184,9 +355,30 @@ namespace unnatural
 
 			static_assert(elevationModesCount == sizeof(elevationModeNames) / sizeof(elevationModeNames[0]), "number of functions and names must match");
 
+			static_assert(elevationModesCount == sizeof(elevationModeBatchFunctions) / sizeof(elevationModeBatchFunctions[0]), "number of functions and batch functions must match");
+
+			// range of values of the elevation function
+			// the noise functions return values in -1 .. 1
+			constexpr Vec2 elevationModeRange[] = {
+				Vec2(100, 100), // none: constant
+				Vec2(-2407, 2001), // simple: the ridged noise gives a in -0.7 .. 1.3, then 100 - ((a * 1.3 - 0.35)^3 + 0.1) * 1000
+				Vec2(-2265, 2986), // legacy: a in -0.89 .. 1.11, then -0.89^0.85 * 2500 .. 1.11^1.7 * 2500
+				Vec2(-106, 1009), // lakes: the land is in -105.7 .. 150.7, mountains add 0 .. 844.9 of ridges (more than the 750 of terraces), plus 12.5 of smoothMax
+				Vec2(-106, 1009), // islands: same as lakes
+				Vec2(10, 248), // craters: the crater profile is in -1 .. 0.249, then 200 + h * 190
+			};
+
+			static_assert(elevationModesCount == sizeof(elevationModeRange) / sizeof(elevationModeRange[0]), "number of functions and ranges must match");
+
 			for (uint32 i = 0; i < elevationModesCount; i++)
+			{
 				if ((String)configElevationMode == elevationModeNames[i])
+				{
 					terrainElevationFnc = elevationModeFunctions[i];
+					terrainElevationBatchFnc = elevationModeBatchFunctions[i];
+					terrainElevationRange = elevationModeRange[i];
+				}
+			}
 			if (!terrainElevationFnc)
 			{
 				CAGE_LOG_THROW(Stringizer() + "elevation mode: '" + (String)configElevationMode + "'");
@@ -205,6 +397,12 @@ namespace unnatural
 
 			constexpr uint32 tileModesCount = sizeof(tileModeFunctions) / sizeof(tileModeFunctions[0]);
 
+			constexpr ColoringFunctor tileModeClimateFunctions[] = {
+				&coloringClimate,
+				nullptr,
+				&coloringClimate,
+			};
+
 			constexpr const char *const tileModeNames[] = {
 				"default",
 				"barren",
@@ -212,10 +410,16 @@ namespace unnatural
 			};
 
 			static_assert(tileModesCount == sizeof(tileModeNames) / sizeof(tileModeNames[0]), "number of functions and names must match");
+			static_assert(tileModesCount == sizeof(tileModeClimateFunctions) / sizeof(tileModeClimateFunctions[0]), "number of functions and climate functions must match");
 
 			for (uint32 i = 0; i < tileModesCount; i++)
+			{
 				if ((String)configColoringMode == tileModeNames[i])
+				{
 					coloringFnc = tileModeFunctions[i];
+					climateFnc = tileModeClimateFunctions[i];
+				}
+			}
 			if (!coloringFnc)
 			{
 				CAGE_LOG_THROW(Stringizer() + "coloring mode: '" + (String)configColoringMode + "'");
@@ -223,8 +427,6 @@ namespace unnatural
 			}
 			CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "using coloring mode: '" + (String)configColoringMode + "'");
 		}
-
-		constexpr Real meshElevationRatio = 10;
 	}
 
 	Real terrainSdfElevation(const Vec3 &pos)
@@ -236,6 +438,34 @@ namespace unnatural
 		return result;
 	}
 
+	Vec3 terrainSdfElevationGradient(const Vec3 &pos)
+	{
+		CAGE_ASSERT(terrainShapeFnc != nullptr);
+		Vec3 result;
+		if (terrainShapeGradientFnc)
+			result = terrainShapeGradientFnc(pos);
+		else
+		{
+			// central differences, all six samples in one batch call
+			static constexpr Real step = 0.5;
+			Vec3 ps[6];
+			Real rs[6];
+			for (uint32 i = 0; i < 3; i++)
+			{
+				ps[i * 2 + 0] = ps[i * 2 + 1] = pos;
+				ps[i * 2 + 0][i] += step;
+				ps[i * 2 + 1][i] -= step;
+			}
+			terrainShapeBatchFnc({ ps, ps + 6 }, { rs, rs + 6 });
+			for (uint32 i = 0; i < 3; i++)
+				result[i] = (rs[i * 2 + 0] - rs[i * 2 + 1]) / (2 * step);
+		}
+		result *= meshElevationRatio;
+		if (!valid(result))
+			CAGE_THROW_ERROR(Exception, "invalid elevation sdf gradient");
+		return result;
+	}
+
 	Real terrainSdfElevationRaw(const Vec3 &pos)
 	{
 		CAGE_ASSERT(terrainElevationFnc != nullptr);
@@ -245,13 +475,21 @@ namespace unnatural
 		return result;
 	}
 
+	Real terrainSdfLand(Real shape, Real elevationRaw)
+	{
+		return shape - elevationRaw / meshElevationRatio;
+	}
+
+	Real terrainSdfNavigation(Real shape, Real elevationRaw)
+	{
+		return shape - max(elevationRaw, 0) / meshElevationRatio;
+	}
+
 	Real terrainSdfLand(const Vec3 &pos)
 	{
 		CAGE_ASSERT(terrainShapeFnc != nullptr);
 		CAGE_ASSERT(terrainElevationFnc != nullptr);
-		const Real base = terrainShapeFnc(pos);
-		const Real elev = terrainElevationFnc(pos) / meshElevationRatio;
-		const Real result = base - elev;
+		const Real result = terrainSdfLand(terrainShapeFnc(pos), terrainElevationFnc(pos));
 		if (!valid(result))
 			CAGE_THROW_ERROR(Exception, "invalid land sdf value");
 		return result;
@@ -266,23 +504,102 @@ namespace unnatural
 		return result;
 	}
 
-	Real terrainSdfNavigation(const Vec3 &pos)
+	void terrainSdfElevationRaw(PointerRange<const Vec3> positions, PointerRange<Real> results)
 	{
-		CAGE_ASSERT(terrainShapeFnc != nullptr);
-		CAGE_ASSERT(terrainElevationFnc != nullptr);
-		const Real base = terrainShapeFnc(pos);
-		const Real elev = terrainElevationFnc(pos) / meshElevationRatio;
-		const Real result = base - max(elev, 0);
-		if (!valid(result))
-			CAGE_THROW_ERROR(Exception, "invalid navigation sdf value");
-		return result;
+		CAGE_ASSERT(terrainElevationBatchFnc != nullptr);
+		terrainElevationBatchFnc(positions, results);
+		for (Real r : results)
+			if (!valid(r))
+				CAGE_THROW_ERROR(Exception, "invalid elevation raw sdf value");
+	}
+
+	// evaluates all three base fields for a row of positions
+	// validity is checked once per row on the sum of the results
+	void terrainSdfWater(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		CAGE_ASSERT(terrainShapeBatchFnc != nullptr);
+		terrainShapeBatchFnc(positions, results);
+		for (Real r : results)
+			if (!valid(r))
+				CAGE_THROW_ERROR(Exception, "invalid water sdf value");
+	}
+
+	// the raw elevation is optional, it may be empty
+	void terrainSdfBase(PointerRange<const Vec3> positions, PointerRange<Real> land, PointerRange<Real> water, PointerRange<Real> navigation, PointerRange<Real> elevation)
+	{
+		CAGE_ASSERT(terrainShapeBatchFnc != nullptr);
+		CAGE_ASSERT(terrainElevationBatchFnc != nullptr);
+		CAGE_ASSERT(positions.size() == land.size() && positions.size() == water.size() && positions.size() == navigation.size());
+		CAGE_ASSERT(elevation.empty() || positions.size() == elevation.size());
+		terrainShapeBatchFnc(positions, water);
+		terrainElevationBatchFnc(positions, navigation); // temporarily stores the raw elevation
+		const uint32 cnt = numeric_cast<uint32>(positions.size());
+		for (uint32 i = 0; i < cnt; i++)
+		{
+			const Real s = water[i];
+			const Real e = navigation[i];
+			CAGE_ASSERT(e >= terrainElevationRange[0] && e <= terrainElevationRange[1]);
+			land[i] = terrainSdfLand(s, e);
+			navigation[i] = terrainSdfNavigation(s, e);
+			if (!elevation.empty())
+				elevation[i] = e;
+			if (!valid(land[i]) || !valid(navigation[i]))
+				CAGE_THROW_ERROR(Exception, "invalid base sdf value");
+		}
+	}
+
+	Real terrainSdfLipschitz()
+	{
+		return terrainShapeLipschitz;
+	}
+
+	// range of the shape minus the sdf of the given purpose
+	Vec2 terrainSdfElevationRange(MeshPurposeEnum purpose)
+	{
+		switch (purpose)
+		{
+			case MeshPurposeEnum::Water:
+				return Vec2();
+			case MeshPurposeEnum::Land:
+				return terrainElevationRange / meshElevationRatio;
+			case MeshPurposeEnum::Navigation:
+				return max(terrainElevationRange, 0) / meshElevationRatio;
+			default:
+				CAGE_THROW_CRITICAL(Exception, "invalid mesh purpose");
+		}
+	}
+
+	Vec2 terrainElevationRawRange()
+	{
+		return terrainElevationRange;
 	}
 
 	void terrainTile(Tile &tile)
 	{
 		CAGE_ASSERT(coloringFnc != nullptr);
 		CAGE_ASSERT(isUnit(tile.normal));
-		coloringFnc(tile);
+		coloringFnc({ &tile, &tile + 1 });
+	}
+
+	void terrainTiles(PointerRange<Tile> tiles)
+	{
+		CAGE_ASSERT(coloringFnc != nullptr);
+		if (tiles.empty())
+			return;
+		coloringFnc(tiles);
+	}
+
+	bool terrainHasClimate()
+	{
+		return climateFnc != nullptr;
+	}
+
+	void terrainClimate(PointerRange<Tile> tiles)
+	{
+		CAGE_ASSERT(climateFnc != nullptr);
+		if (tiles.empty())
+			return;
+		climateFnc(tiles);
 	}
 
 	void terrainPreseed()
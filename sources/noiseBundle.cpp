@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <vector>
+
+#include "noiseBundle.h"
+
+namespace unnatural
+{
+	namespace
+	{
+		constexpr uint32 BlockSize = 64; // limits the temporary memory allocated on stack
+	}
+
+	class NoiseBundleImpl : public NoiseBundle
+	{
+	public:
+		struct Group
+		{
+			Real frequency;
+			std::vector<uint32> members;
+		};
+
+		// the members are created with unit frequency, the frequency is applied by the shared transformation of their group
+		std::vector<Holder<NoiseFunction>> members;
+		std::vector<Group> groups;
+
+		NoiseBundleImpl(PointerRange<const NoiseFunctionCreateConfig> configs)
+		{
+			CAGE_ASSERT(!configs.empty());
+			members.reserve(configs.size());
+			for (const NoiseFunctionCreateConfig &cfg : configs)
+			{
+				const uint32 index = numeric_cast<uint32>(members.size());
+				NoiseFunctionCreateConfig c = cfg;
+				c.frequency = 1;
+				members.push_back(newNoiseFunction(c));
+				auto it = std::find_if(groups.begin(), groups.end(), [&](const Group &g) { return g.frequency == cfg.frequency; });
+				if (it == groups.end())
+				{
+					groups.push_back({ cfg.frequency, {} });
+					it = groups.end() - 1;
+				}
+				it->members.push_back(index);
+			}
+		}
+
+		void evaluate(const Vec3 &position, PointerRange<Real> results) const
+		{
+			CAGE_ASSERT(results.size() == members.size());
+			for (const Group &g : groups)
+			{
+				const Vec3 p = position * g.frequency;
+				for (uint32 m : g.members)
+					results[m] = members[m]->evaluate(p);
+			}
+		}
+
+		void evaluate(PointerRange<const Vec3> positions, PointerRange<const Real> scales, PointerRange<Real> results) const
+		{
+			CAGE_ASSERT(scales.empty() || scales.size() == positions.size());
+			CAGE_ASSERT(results.size() == positions.size() * members.size());
+			const uint32 total = numeric_cast<uint32>(positions.size());
+			Vec3 transformed[BlockSize];
+			for (uint32 offset = 0; offset < total; offset += BlockSize)
+			{
+				const uint32 cnt = min(total - offset, BlockSize);
+				for (const Group &g : groups)
+				{
+					for (uint32 i = 0; i < cnt; i++)
+						transformed[i] = positions[offset + i] * (scales.empty() ? g.frequency : scales[offset + i] * g.frequency);
+					for (uint32 m : g.members)
+					{
+						Real *r = results.data() + m * total + offset;
+						members[m]->evaluate({ transformed, transformed + cnt }, { r, r + cnt });
+					}
+				}
+			}
+		}
+	};
+
+	uint32 NoiseBundle::count() const
+	{
+		const NoiseBundleImpl *impl = (const NoiseBundleImpl *)this;
+		return numeric_cast<uint32>(impl->members.size());
+	}
+
+	void NoiseBundle::evaluate(const Vec3 &position, PointerRange<Real> results) const
+	{
+		const NoiseBundleImpl *impl = (const NoiseBundleImpl *)this;
+		impl->evaluate(position, results);
+	}
+
+	void NoiseBundle::evaluate(PointerRange<const Vec3> positions, PointerRange<const Real> scales, PointerRange<Real> results) const
+	{
+		const NoiseBundleImpl *impl = (const NoiseBundleImpl *)this;
+		impl->evaluate(positions, scales, results);
+	}
+
+	Holder<NoiseBundle> newNoiseBundle(PointerRange<const NoiseFunctionCreateConfig> configs)
+	{
+		return systemMemory().createImpl<NoiseBundle, NoiseBundleImpl>(configs);
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef noiseBundle_h_p7w2c4nd
+#define noiseBundle_h_p7w2c4nd
+
+#include "planets.h"
+
+#include <cage-core/noiseFunction.h>
+
+namespace unnatural
+{
+	// several noise functions evaluated together at shared positions
+	// the positions are transformed once for each distinct frequency, and the members with the same frequency share the transformed positions
+	class NoiseBundle : private Immovable
+	{
+	public:
+		uint32 count() const;
+
+		// results receive one value per member
+		void evaluate(const Vec3 &position, PointerRange<Real> results) const;
+
+		// each position is multiplied by its scale before the evaluation, scales may be empty
+		// results are member-major: value of member m at position i is at results[m * positions.size() + i]
+		void evaluate(PointerRange<const Vec3> positions, PointerRange<const Real> scales, PointerRange<Real> results) const;
+	};
+
+	Holder<NoiseBundle> newNoiseBundle(PointerRange<const NoiseFunctionCreateConfig> configs);
+}
+
+#endif
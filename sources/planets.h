@@ -71,8 +71,8 @@ namespace unnatural
 		Real height;
 		Real elevation;
 		Rads slope;
-		Real temperature;
-		Real precipitation;
+		Real temperature = Real::Nan(); // nan until computed, or provided by interpolation
+		Real precipitation = Real::Nan();
 		Real opacity = 1;
 		Real flatRadius;
 		const DoodadDefinition *doodad = nullptr;
@@ -1,12 +1,27 @@
+#include <vector>
+
+#include "fastMath.h"
 #include "sdf.h"
-#include "math.h"
 
 #include <cage-core/geometry.h>
 #include <cage-core/noiseFunction.h>
 #include <cage-core/random.h>
+#include <cage-core/string.h>
 
 namespace unnatural
 {
+	namespace
+	{
+		template<Real (*F)(const Vec3 &)>
+		void sdfBatch(PointerRange<const Vec3> positions, PointerRange<Real> results)
+		{
+			CAGE_ASSERT(positions.size() == results.size());
+			const uint32 cnt = numeric_cast<uint32>(positions.size());
+			for (uint32 i = 0; i < cnt; i++)
+				results[i] = F(positions[i]);
+		}
+	}
+
 	Real sdfHexagon(const Vec3 &pos)
 	{
 		return sdfPlane(pos, Plane(Vec3(), normalize(Vec3(1, 1, -1))));
@@ -209,7 +224,7 @@ namespace unnatural
 			return 0;
 		const Vec3 pos = pos_ * 0.0004;
 		// taken from https://www.shadertoy.com/view/wstcDN and modified
-		static constexpr Real Power = 3.0;
+		static constexpr uint32 Power = 3;
 		Vec3 z = pos;
 		Real dr = 1.0;
 		Real r = 0.0;
@@ -218,16 +233,17 @@ namespace unnatural
 			r = length(z);
 			if (r > 4.0)
 				break;
-			Rads theta = acos(z[2] / r);
-			Rads phi = atan2(z[1], z[0]);
-			dr = pow(r, Power - 1.0) * Power * dr + 1.0;
-			Real zr = pow(r, Power);
-			theta = theta * Power;
-			phi = phi * Power;
-			z = zr * Vec3(sin(theta) * cos(phi), sin(phi) * sin(theta), cos(theta));
+			Rads theta = fastAcos(z[2] / r);
+			Rads phi = fastAtan2(z[1], z[0]);
+			static_assert(Power == 3); // the powers below are expanded for this exponent
+			dr = r * r * Real(Power) * dr + 1.0; // pow(r, Power - 1)
+			Real zr = r * r * r; // pow(r, Power)
+			theta = theta * Real(Power);
+			phi = phi * Real(Power);
+			z = zr * Vec3(fastSin(theta) * fastCos(phi), fastSin(phi) * fastSin(theta), fastCos(theta));
 			z += pos;
 		}
-		const Real value = 0.5 * log(r) * r / dr;
+		const Real value = 0.5 * fastLog(r) * r / dr;
 		return (value + 0.1) * 150;
 	}
 
@@ -242,64 +258,285 @@ namespace unnatural
 
 	namespace
 	{
+		// same sine as in the batch evaluation, so that both evaluations agree
 		Vec4 sin(Vec4 a)
 		{
 			for (uint32 i = 0; i < 4; i++)
-				a[i] = sin(Rads(a[i]));
+				a[i] = fastSin(Rads(a[i]));
 			return a;
 		}
 
-		Real sdfBunnyImpl(const Vec3 &p)
+		// small neural network with sine activations and residual connections in the hidden layers
+		struct SineNetwork
 		{
-			// https://www.shadertoy.com/view/wtVyWK
-			if (length(p) > 1)
-				return length(p) - 0.8;
-			Vec4 f00 = sin(p[1] * Vec4(-3.02, 1.95, -3.42, -.60) + p[2] * Vec4(3.08, .85, -2.25, -.24) - p[0] * Vec4(-.29, 1.16, -3.74, 2.89) + Vec4(-.71, 4.50, -3.24, -3.50));
-			Vec4 f01 = sin(p[1] * Vec4(-.40, -3.61, 3.23, -.14) + p[2] * Vec4(-.36, 3.64, -3.91, 2.66) - p[0] * Vec4(2.90, -.54, -2.75, 2.71) + Vec4(7.02, -5.41, -1.12, -7.41));
-			Vec4 f02 = sin(p[1] * Vec4(-1.77, -1.28, -4.29, -3.20) + p[2] * Vec4(-3.49, -2.81, -.64, 2.79) - p[0] * Vec4(3.15, 2.14, -3.85, 1.83) + Vec4(-2.07, 4.49, 5.33, -2.17));
-			Vec4 f03 = sin(p[1] * Vec4(-.49, .68, 3.05, .42) + p[2] * Vec4(-2.87, .78, 3.78, -3.41) - p[0] * Vec4(-2.65, .33, .07, -.64) + Vec4(-3.24, -5.90, 1.14, -4.71));
-			Vec4 f10 = sin(Mat4(-.34, .06, -.59, -.76, .10, -.19, -.12, .44, .64, -.02, -.26, .15, -.16, .21, .91, .15) * f00 + Mat4(.01, .54, -.77, .11, .06, -.14, .43, .51, -.18, .08, .39, .20, .33, -.49, -.10, .19) * f01 + Mat4(.27, .22, .43, .53, .18, -.17, .23, -.64, -.14, .02, -.10, .16, -.13, -.06, -.04, -.36) * f02 + Mat4(-.13, .29, -.29, .08, 1.13, .02, -.83, .32, -.32, .04, -.31, -.16, .14, -.03, -.20, .39) * f03 + Vec4(.73, -4.28, -1.56, -1.80)) / 1.0 + f00;
-			Vec4 f11 = sin(Mat4(-1.11, .55, -.12, -1.00, .16, .15, -.30, .31, -.01, .01, .31, -.42, -.29, .38, -.04, .71) * f00 + Mat4(.96, -.02, .86, .52, -.14, .60, .44, .43, .02, -.15, -.49, -.05, -.06, -.25, -.03, -.22) * f01 + Mat4(.52, .44, -.05, -.11, -.56, -.10, -.61, -.40, -.04, .55, .32, -.07, -.02, .28, .26, -.49) * f02 + Mat4(.02, -.32, .06, -.17, -.59, .00, -.24, .60, -.06, .13, -.21, -.27, -.12, -.14, .58, -.55) * f03 + Vec4(-2.24, -3.48, -.80, 1.41)) / 1.0 + f01;
-			Vec4 f12 = sin(Mat4(.44, -.06, -.79, -.46, .05, -.60, .30, .36, .35, .12, .02, .12, .40, -.26, .63, -.21) * f00 + Mat4(-.48, .43, -.73, -.40, .11, -.01, .71, .05, -.25, .25, -.28, -.20, .32, -.02, -.84, .16) * f01 + Mat4(.39, -.07, .90, .36, -.38, -.27, -1.86, -.39, .48, -.20, -.05, .10, -.00, -.21, .29, .63) * f02 + Mat4(.46, -.32, .06, .09, .72, -.47, .81, .78, .90, .02, -.21, .08, -.16, .22, .32, -.13) * f03 + Vec4(3.38, 1.20, .84, 1.41)) / 1.0 + f02;
-			Vec4 f13 = sin(Mat4(-.41, -.24, -.71, -.25, -.24, -.75, -.09, .02, -.27, -.42, .02, .03, -.01, .51, -.12, -1.24) * f00 + Mat4(.64, .31, -1.36, .61, -.34, .11, .14, .79, .22, -.16, -.29, -.70, .02, -.37, .49, .39) * f01 + Mat4(.79, .47, .54, -.47, -1.13, -.35, -1.03, -.22, -.67, -.26, .10, .21, -.07, -.73, -.11, .72) * f02 + Mat4(.43, -.23, .13, .09, 1.38, -.63, 1.57, -.20, .39, -.14, .42, .13, -.57, -.08, -.21, .21) * f03 + Vec4(-.34, -3.28, .43, -.52)) / 1.0 + f03;
-			f00 = sin(Mat4(-.72, .23, -.89, .52, .38, .19, -.16, -.88, .26, -.37, .09, .63, .29, -.72, .30, -.95) * f10 + Mat4(-.22, -.51, -.42, -.73, -.32, .00, -1.03, 1.17, -.20, -.03, -.13, -.16, -.41, .09, .36, -.84) * f11 + Mat4(-.21, .01, .33, .47, .05, .20, -.44, -1.04, .13, .12, -.13, .31, .01, -.34, .41, -.34) * f12 + Mat4(-.13, -.06, -.39, -.22, .48, .25, .24, -.97, -.34, .14, .42, -.00, -.44, .05, .09, -.95) * f13 + Vec4(.48, .87, -.87, -2.06)) / 1.4 + f10;
-			f01 = sin(Mat4(-.27, .29, -.21, .15, .34, -.23, .85, -.09, -1.15, -.24, -.05, -.25, -.12, -.73, -.17, -.37) * f10 + Mat4(-1.11, .35, -.93, -.06, -.79, -.03, -.46, -.37, .60, -.37, -.14, .45, -.03, -.21, .02, .59) * f11 + Mat4(-.92, -.17, -.58, -.18, .58, .60, .83, -1.04, -.80, -.16, .23, -.11, .08, .16, .76, .61) * f12 + Mat4(.29, .45, .30, .39, -.91, .66, -.35, -.35, .21, .16, -.54, -.63, 1.10, -.38, .20, .15) * f13 + Vec4(-1.72, -.14, 1.92, 2.08)) / 1.4 + f11;
-			f02 = sin(Mat4(1.00, .66, 1.30, -.51, .88, .25, -.67, .03, -.68, -.08, -.12, -.14, .46, 1.15, .38, -.10) * f10 + Mat4(.51, -.57, .41, -.09, .68, -.50, -.04, -1.01, .20, .44, -.60, .46, -.09, -.37, -1.30, .04) * f11 + Mat4(.14, .29, -.45, -.06, -.65, .33, -.37, -.95, .71, -.07, 1.00, -.60, -1.68, -.20, -.00, -.70) * f12 + Mat4(-.31, .69, .56, .13, .95, .36, .56, .59, -.63, .52, -.30, .17, 1.23, .72, .95, .75) * f13 + Vec4(-.90, -3.26, -.44, -3.11)) / 1.4 + f12;
-			f03 = sin(Mat4(.51, -.98, -.28, .16, -.22, -.17, -1.03, .22, .70, -.15, .12, .43, .78, .67, -.85, -.25) * f10 + Mat4(.81, .60, -.89, .61, -1.03, -.33, .60, -.11, -.06, .01, -.02, -.44, .73, .69, 1.02, .62) * f11 + Mat4(-.10, .52, .80, -.65, .40, -.75, .47, 1.56, .03, .05, .08, .31, -.03, .22, -1.63, .07) * f12 + Mat4(-.18, -.07, -1.22, .48, -.01, .56, .07, .15, .24, .25, -.09, -.54, .23, -.08, .20, .36) * f13 + Vec4(-1.11, -4.28, 1.02, -.23)) / 1.4 + f13;
-			return dot(f00, Vec4(.09, .12, -.07, -.03)) + dot(f01, Vec4(-.04, .07, -.08, .05)) + dot(f02, Vec4(-.01, .06, -.02, .07)) + dot(f03, Vec4(-.05, .07, .03, .04)) - 0.16;
+			struct Input
+			{
+				Vec4 x, y, z, bias;
+			} input[4];
+			struct Hidden
+			{
+				Mat4 weights[4][4];
+				Vec4 bias[4];
+				Real scale;
+			} hidden[2];
+			Vec4 output[4];
+			Real outputBias;
+
+			Real evaluate(const Vec3 &p) const
+			{
+				if (length(p) > 1)
+					return length(p) - 0.8;
+				Vec4 f[4];
+				for (uint32 k = 0; k < 4; k++)
+					f[k] = sin(p[1] * input[k].y + p[2] * input[k].z + p[0] * input[k].x + input[k].bias);
+				for (const Hidden &h : hidden)
+				{
+					Vec4 g[4];
+					for (uint32 k = 0; k < 4; k++)
+						g[k] = sin(h.weights[k][0] * f[0] + h.weights[k][1] * f[1] + h.weights[k][2] * f[2] + h.weights[k][3] * f[3] + h.bias[k]) / h.scale + f[k];
+					for (uint32 k = 0; k < 4; k++)
+						f[k] = g[k];
+				}
+				return dot(f[0], output[0]) + dot(f[1], output[1]) + dot(f[2], output[2]) + dot(f[3], output[3]) + outputBias;
+			}
+		};
+
+		// https://www.shadertoy.com/view/wtVyWK
+		const SineNetwork bunnyNetwork = {
+			{
+				{ Vec4(.29, -1.16, 3.74, -2.89), Vec4(-3.02, 1.95, -3.42, -.60), Vec4(3.08, .85, -2.25, -.24), Vec4(-.71, 4.50, -3.24, -3.50) },
+				{ Vec4(-2.90, .54, 2.75, -2.71), Vec4(-.40, -3.61, 3.23, -.14), Vec4(-.36, 3.64, -3.91, 2.66), Vec4(7.02, -5.41, -1.12, -7.41) },
+				{ Vec4(-3.15, -2.14, 3.85, -1.83), Vec4(-1.77, -1.28, -4.29, -3.20), Vec4(-3.49, -2.81, -.64, 2.79), Vec4(-2.07, 4.49, 5.33, -2.17) },
+				{ Vec4(2.65, -.33, -.07, .64), Vec4(-.49, .68, 3.05, .42), Vec4(-2.87, .78, 3.78, -3.41), Vec4(-3.24, -5.90, 1.14, -4.71) },
+			},
+			{
+				{
+					{
+						{ Mat4(-.34, .06, -.59, -.76, .10, -.19, -.12, .44, .64, -.02, -.26, .15, -.16, .21, .91, .15), Mat4(.01, .54, -.77, .11, .06, -.14, .43, .51, -.18, .08, .39, .20, .33, -.49, -.10, .19), Mat4(.27, .22, .43, .53, .18, -.17, .23, -.64, -.14, .02, -.10, .16, -.13, -.06, -.04, -.36), Mat4(-.13, .29, -.29, .08, 1.13, .02, -.83, .32, -.32, .04, -.31, -.16, .14, -.03, -.20, .39) },
+						{ Mat4(-1.11, .55, -.12, -1.00, .16, .15, -.30, .31, -.01, .01, .31, -.42, -.29, .38, -.04, .71), Mat4(.96, -.02, .86, .52, -.14, .60, .44, .43, .02, -.15, -.49, -.05, -.06, -.25, -.03, -.22), Mat4(.52, .44, -.05, -.11, -.56, -.10, -.61, -.40, -.04, .55, .32, -.07, -.02, .28, .26, -.49), Mat4(.02, -.32, .06, -.17, -.59, .00, -.24, .60, -.06, .13, -.21, -.27, -.12, -.14, .58, -.55) },
+						{ Mat4(.44, -.06, -.79, -.46, .05, -.60, .30, .36, .35, .12, .02, .12, .40, -.26, .63, -.21), Mat4(-.48, .43, -.73, -.40, .11, -.01, .71, .05, -.25, .25, -.28, -.20, .32, -.02, -.84, .16), Mat4(.39, -.07, .90, .36, -.38, -.27, -1.86, -.39, .48, -.20, -.05, .10, -.00, -.21, .29, .63), Mat4(.46, -.32, .06, .09, .72, -.47, .81, .78, .90, .02, -.21, .08, -.16, .22, .32, -.13) },
+						{ Mat4(-.41, -.24, -.71, -.25, -.24, -.75, -.09, .02, -.27, -.42, .02, .03, -.01, .51, -.12, -1.24), Mat4(.64, .31, -1.36, .61, -.34, .11, .14, .79, .22, -.16, -.29, -.70, .02, -.37, .49, .39), Mat4(.79, .47, .54, -.47, -1.13, -.35, -1.03, -.22, -.67, -.26, .10, .21, -.07, -.73, -.11, .72), Mat4(.43, -.23, .13, .09, 1.38, -.63, 1.57, -.20, .39, -.14, .42, .13, -.57, -.08, -.21, .21) },
+					},
+					{ Vec4(.73, -4.28, -1.56, -1.80), Vec4(-2.24, -3.48, -.80, 1.41), Vec4(3.38, 1.20, .84, 1.41), Vec4(-.34, -3.28, .43, -.52) },
+					1.0,
+				},
+				{
+					{
+						{ Mat4(-.72, .23, -.89, .52, .38, .19, -.16, -.88, .26, -.37, .09, .63, .29, -.72, .30, -.95), Mat4(-.22, -.51, -.42, -.73, -.32, .00, -1.03, 1.17, -.20, -.03, -.13, -.16, -.41, .09, .36, -.84), Mat4(-.21, .01, .33, .47, .05, .20, -.44, -1.04, .13, .12, -.13, .31, .01, -.34, .41, -.34), Mat4(-.13, -.06, -.39, -.22, .48, .25, .24, -.97, -.34, .14, .42, -.00, -.44, .05, .09, -.95) },
+						{ Mat4(-.27, .29, -.21, .15, .34, -.23, .85, -.09, -1.15, -.24, -.05, -.25, -.12, -.73, -.17, -.37), Mat4(-1.11, .35, -.93, -.06, -.79, -.03, -.46, -.37, .60, -.37, -.14, .45, -.03, -.21, .02, .59), Mat4(-.92, -.17, -.58, -.18, .58, .60, .83, -1.04, -.80, -.16, .23, -.11, .08, .16, .76, .61), Mat4(.29, .45, .30, .39, -.91, .66, -.35, -.35, .21, .16, -.54, -.63, 1.10, -.38, .20, .15) },
+						{ Mat4(1.00, .66, 1.30, -.51, .88, .25, -.67, .03, -.68, -.08, -.12, -.14, .46, 1.15, .38, -.10), Mat4(.51, -.57, .41, -.09, .68, -.50, -.04, -1.01, .20, .44, -.60, .46, -.09, -.37, -1.30, .04), Mat4(.14, .29, -.45, -.06, -.65, .33, -.37, -.95, .71, -.07, 1.00, -.60, -1.68, -.20, -.00, -.70), Mat4(-.31, .69, .56, .13, .95, .36, .56, .59, -.63, .52, -.30, .17, 1.23, .72, .95, .75) },
+						{ Mat4(.51, -.98, -.28, .16, -.22, -.17, -1.03, .22, .70, -.15, .12, .43, .78, .67, -.85, -.25), Mat4(.81, .60, -.89, .61, -1.03, -.33, .60, -.11, -.06, .01, -.02, -.44, .73, .69, 1.02, .62), Mat4(-.10, .52, .80, -.65, .40, -.75, .47, 1.56, .03, .05, .08, .31, -.03, .22, -1.63, .07), Mat4(-.18, -.07, -1.22, .48, -.01, .56, .07, .15, .24, .25, -.09, -.54, .23, -.08, .20, .36) },
+					},
+					{ Vec4(.48, .87, -.87, -2.06), Vec4(-1.72, -.14, 1.92, 2.08), Vec4(-.90, -3.26, -.44, -3.11), Vec4(-1.11, -4.28, 1.02, -.23) },
+					1.4,
+				},
+			},
+			{ Vec4(.09, .12, -.07, -.03), Vec4(-.04, .07, -.08, .05), Vec4(-.01, .06, -.02, .07), Vec4(-.05, .07, .03, .04) },
+			-0.16,
+		};
+
+		// https://www.shadertoy.com/view/wtdBzn
+		const SineNetwork monkeyHeadNetwork = {
+			{
+				{ Vec4(-3.646, 3.086, 4.005, 1.374), Vec4(-.810, -.479, -1.629, 2.114), Vec4(-1.353, 3.836, .544, -.242), Vec4(5.029, -.860, -4.521, -7.561) },
+				{ Vec4(-2.583, 1.946, -.381, 1.358), Vec4(.551, -3.838, -1.237, -3.779), Vec4(-2.141, -1.009, -.282, -.317), Vec4(8.011, -7.240, 7.978, 6.555) },
+				{ Vec4(-3.354, -1.616, -4.604, -1.501), Vec4(.292, .009, .083, -3.117), Vec4(2.295, 1.412, -.507, -4.047), Vec4(5.055, .519, 3.222, 3.231) },
+				{ Vec4(-.440, 2.221, -2.129, -.953), Vec4(.644, 1.538, -1.473, -2.874), Vec4(2.361, -4.293, -1.496, 3.907), Vec4(-2.102, 7.426, -6.489, -2.261) },
+			},
+			{
+				{
+					{
+						{ Mat4(.469, -.455, -.016, .000, .041, -.230, .641, .877, -.771, .400, .439, .275, .240, -.504, .618, .868), Mat4(.497, -.162, .044, .878, .289, -.741, .552, .162, .043, .296, .299, .988, .103, .027, .242, .600), Mat4(-.030, -.218, .097, .515, -1.296, .868, -.517, .854, .024, -.069, .573, .398, -.072, -.068, -.196, -.232), Mat4(-.913, .914, -.583, .229, .201, -1.052, -.087, -.908, -.354, -.067, .446, -.428, .458, .056, -.531, .221) },
+						{ Mat4(-.213, -.215, .364, -.477, -.218, -.111, .141, -.462, .724, -.350, -.379, .120, -.372, .407, -.094, 1.104), Mat4(-.065, .780, .630, -.243, .039, -.759, -.154, .121, -.828, .536, .678, -.823, .513, .830, -.145, .553), Mat4(.764, .387, .054, -.431, -.049, .524, .044, .891, -.159, .182, .217, .611, .119, -.355, .228, .030), Mat4(.526, .020, -.521, -.366, -.465, .357, .082, -.368, .160, .649, -.506, -.260, .154, .482, .222, .393) },
+						{ Mat4(-.587, -.235, .031, -.583, .384, .405, .167, .339, .778, -.499, -.311, -.154, -.279, 1.064, -.609, -.058), Mat4(-.191, .059, .284, .086, -.658, .495, -.015, -.757, 1.143, .597, .475, .298, -.124, -.505, -.401, -.212), Mat4(.221, .421, -.376, .462, .568, .661, .542, -.524, .471, -.726, -.520, .528, .069, .454, .352, .780), Mat4(.359, -.025, -.730, -.488, -.865, -.103, -.015, .098, .592, .204, .398, -.472, .072, .396, -.346, -.258) },
+						{ Mat4(-.786, .057, .116, .141, -.233, -.241, .325, -.200, .092, -.531, -.053, .152, -.605, -.351, .413, -.274), Mat4(.104, -.249, .320, -.261, -.095, .060, .786, -.063, -.070, -.468, .052, -.558, -.557, .009, -.192, .280), Mat4(-.664, .297, -.124, .113, -.284, .734, .425, -.340, .081, -.133, -.049, -.209, -.310, .368, -.003, -.391), Mat4(.015, -.185, .427, -.442, .191, .139, -.420, -.262, .254, -.068, .632, .151, .395, -.000, .067, .670) },
+					},
+					{ Vec4(2.389, 3.737, 2.563, 1.536), Vec4(-.538, .688, -1.270, .721), Vec4(3.503, 3.117, 1.734, -2.248), Vec4(-3.185, 1.715, 3.541, 1.726) },
+					1.0,
+				},
+				{
+					{
+						{ Mat4(-.876, -.128, .620, -.979, -.052, .201, .492, .232, -.393, -1.020, -.527, -.172, -.143, .127, .526, .223), Mat4(.643, .102, 1.161, -.555, -.587, -1.253, .246, -.111, .884, -.944, -.620, .048, .468, -.753, -.040, -.534), Mat4(.257, -.309, .046, .005, -.313, 1.355, -.042, -.088, -.046, -.452, .437, .431, .142, -.044, .253, -.020), Mat4(-.040, .884, -.167, .816, -.312, -.448, -.929, .809, .502, .072, .851, -1.144, .023, .736, -.080, .056) },
+						{ Mat4(.324, -.439, -.328, -.771, -.307, -.151, .168, .269, -.978, -1.237, .658, -.216, .229, -.954, -.225, -.464), Mat4(.514, .160, -.566, -.157, -.830, -.443, -.369, -.660, -1.208, 1.357, .158, .107, .275, -.202, -.144, .006), Mat4(.757, -.337, -.144, -1.115, .723, .438, -.499, -.044, .046, -.262, .427, -.044, .183, .316, -.389, -.124), Mat4(-1.063, .047, -.112, .194, .351, -.459, -.209, -.313, -1.771, .433, -.779, .359, .213, .522, -.227, .788) },
+						{ Mat4(.562, .796, .458, -.584, -1.463, .710, .360, .128, .025, .451, -.141, .300, .276, .329, -.382, -.444), Mat4(.377, .319, -.050, .104, .513, -.419, -.201, -.242, .129, .014, -.087, .316, -.012, -.618, -.390, -.426), Mat4(.299, -.244, .703, -.758, .281, -.135, .835, .354, .241, -.139, .414, .848, -.815, .236, .800, .217), Mat4(.591, -.381, .696, .199, -.191, -.221, .618, -.531, -.554, .518, -.982, -.010, .194, .181, .784, -1.140) },
+						{ Mat4(.052, -.589, -1.287, -.338, -.999, .079, .048, .152, -.585, .255, -.721, -.240, -.659, .360, -.016, -.408), Mat4(.186, .057, -.968, .225, .450, -1.048, -.710, .375, .821, -.730, -.037, .656, .333, .159, .292, .066), Mat4(.296, .372, -.202, -.562, .510, .041, .037, -.401, -.064, -.203, -.500, -.026, -.587, -.020, .603, -.177), Mat4(.758, .219, .271, -.131, -.116, -.485, .337, .013, -.380, -.716, -.644, .468, -.297, .552, 1.275, -.132) },
+					},
+					{ Vec4(3.092, -.379, -.619, 3.235), Vec4(-1.385, -.939, -2.511, -.512), Vec4(3.316, .154, 1.061, 2.237), Vec4(2.659, .165, -2.731, 2.476) },
+					1.4,
+				},
+			},
+			{ Vec4(.062, -.040, -.074, -.047), Vec4(-.057, -.039, -.071, -.057), Vec4(-.025, -.054, .044, .045), Vec4(.048, .066, -.058, .100) },
+			0.102,
+		};
+
+		// the network with dense weights, evaluated on blocks of points at once
+		// the layers are matrix-matrix products over the block, with points in the inner loops, which the compiler vectorizes
+		struct DenseSineNetwork
+		{
+			static constexpr uint32 Width = 16;
+			static constexpr uint32 BlockSize = 64;
+
+			Real input[Width][4] = {}; // x, y, z, bias
+			Real hidden[2][Width][Width] = {};
+			Real hiddenBias[2][Width] = {};
+			Real hiddenScale[2] = {};
+			Real output[Width] = {};
+			Real outputBias;
+
+			explicit DenseSineNetwork(const SineNetwork &n)
+			{
+				for (uint32 k = 0; k < 4; k++)
+				{
+					for (uint32 i = 0; i < 4; i++)
+					{
+						Real *in = input[k * 4 + i];
+						in[0] = n.input[k].x[i];
+						in[1] = n.input[k].y[i];
+						in[2] = n.input[k].z[i];
+						in[3] = n.input[k].bias[i];
+						output[k * 4 + i] = n.output[k][i];
+					}
+				}
+				for (uint32 l = 0; l < 2; l++)
+				{
+					const SineNetwork::Hidden &h = n.hidden[l];
+					hiddenScale[l] = h.scale;
+					for (uint32 k = 0; k < 4; k++)
+					{
+						for (uint32 i = 0; i < 4; i++)
+							hiddenBias[l][k * 4 + i] = h.bias[k][i];
+						// extract the matrix columns by multiplying with basis vectors
+						for (uint32 j = 0; j < 4; j++)
+						{
+							for (uint32 c = 0; c < 4; c++)
+							{
+								Vec4 e;
+								e[c] = 1;
+								const Vec4 col = h.weights[k][j] * e;
+								for (uint32 r = 0; r < 4; r++)
+									hidden[l][k * 4 + r][j * 4 + c] = col[r];
+							}
+						}
+					}
+				}
+				outputBias = n.outputBias;
+			}
+
+			// positions must be already transformed into the space of the network
+			void evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results) const
+			{
+				CAGE_ASSERT(positions.size() == results.size());
+				const uint32 total = numeric_cast<uint32>(positions.size());
+				for (uint32 offset = 0; offset < total; offset += BlockSize)
+				{
+					const uint32 end = min(total, offset + BlockSize);
+
+					// only points inside the unit sphere need the network
+					Real px[BlockSize], py[BlockSize], pz[BlockSize];
+					uint32 ids[BlockSize];
+					uint32 cnt = 0;
+					for (uint32 i = offset; i < end; i++)
+					{
+						const Vec3 &p = positions[i];
+						const Real l = length(p);
+						if (l > 1)
+						{
+							results[i] = l - 0.8;
+							continue;
+						}
+						px[cnt] = p[0];
+						py[cnt] = p[1];
+						pz[cnt] = p[2];
+						ids[cnt] = i;
+						cnt++;
+					}
+					if (cnt == 0)
+						continue;
+
+					Real a[Width][BlockSize], t[Width][BlockSize];
+					for (uint32 u = 0; u < Width; u++)
+					{
+						const Real *in = input[u];
+						for (uint32 i = 0; i < cnt; i++)
+							a[u][i] = fastSin(Rads(py[i] * in[1] + pz[i] * in[2] + px[i] * in[0] + in[3]));
+					}
+
+					for (uint32 l = 0; l < 2; l++)
+					{
+						for (uint32 u = 0; u < Width; u++)
+						{
+							for (uint32 i = 0; i < cnt; i++)
+								t[u][i] = hiddenBias[l][u];
+							for (uint32 v = 0; v < Width; v++)
+							{
+								const Real w = hidden[l][u][v];
+								for (uint32 i = 0; i < cnt; i++)
+									t[u][i] += w * a[v][i];
+							}
+						}
+						const Real invScale = 1 / hiddenScale[l];
+						for (uint32 u = 0; u < Width; u++)
+							for (uint32 i = 0; i < cnt; i++)
+								t[u][i] = fastSin(Rads(t[u][i])) * invScale + a[u][i];
+						std::swap(a, t);
+					}
+
+					Real r[BlockSize];
+					for (uint32 i = 0; i < cnt; i++)
+						r[i] = outputBias;
+					for (uint32 u = 0; u < Width; u++)
+						for (uint32 i = 0; i < cnt; i++)
+							r[i] += output[u] * a[u][i];
+					for (uint32 i = 0; i < cnt; i++)
+						results[ids[i]] = r[i];
+				}
+			}
+		};
+
+		const DenseSineNetwork &denseBunnyNetwork()
+		{
+			static const DenseSineNetwork network(bunnyNetwork);
+			return network;
+		}
+
+		const DenseSineNetwork &denseMonkeyHeadNetwork()
+		{
+			static const DenseSineNetwork network(monkeyHeadNetwork);
+			return network;
 		}
 
-		Real sdfMonkeyHeadImpl(const Vec3 &p)
+		void sdfNetworkBatch(const DenseSineNetwork &dense, PointerRange<const Vec3> positions, PointerRange<Real> results)
 		{
-			// https://www.shadertoy.com/view/wtdBzn
-			if (length(p) > 1.)
-				return length(p) - 0.8;
-			Vec4 f0_0 = sin(p[1] * Vec4(-.810, -.479, -1.629, 2.114) + p[2] * Vec4(-1.353, 3.836, .544, -.242) + p[0] * Vec4(-3.646, 3.086, 4.005, 1.374) + Vec4(5.029, -.860, -4.521, -7.561));
-			Vec4 f0_1 = sin(p[1] * Vec4(.551, -3.838, -1.237, -3.779) + p[2] * Vec4(-2.141, -1.009, -.282, -.317) + p[0] * Vec4(-2.583, 1.946, -.381, 1.358) + Vec4(8.011, -7.240, 7.978, 6.555));
-			Vec4 f0_2 = sin(p[1] * Vec4(.292, .009, .083, -3.117) + p[2] * Vec4(2.295, 1.412, -.507, -4.047) + p[0] * Vec4(-3.354, -1.616, -4.604, -1.501) + Vec4(5.055, .519, 3.222, 3.231));
-			Vec4 f0_3 = sin(p[1] * Vec4(.644, 1.538, -1.473, -2.874) + p[2] * Vec4(2.361, -4.293, -1.496, 3.907) + p[0] * Vec4(-.440, 2.221, -2.129, -.953) + Vec4(-2.102, 7.426, -6.489, -2.261));
-			Vec4 f1_0 = sin(Mat4(.469, -.455, -.016, .000, .041, -.230, .641, .877, -.771, .400, .439, .275, .240, -.504, .618, .868) * f0_0 + Mat4(.497, -.162, .044, .878, .289, -.741, .552, .162, .043, .296, .299, .988, .103, .027, .242, .600) * f0_1 + Mat4(-.030, -.218, .097, .515, -1.296, .868, -.517, .854, .024, -.069, .573, .398, -.072, -.068, -.196, -.232) * f0_2 + Mat4(-.913, .914, -.583, .229, .201, -1.052, -.087, -.908, -.354, -.067, .446, -.428, .458, .056, -.531, .221) * f0_3 + Vec4(2.389, 3.737, 2.563, 1.536)) / 1.0 + f0_0;
-			Vec4 f1_1 = sin(Mat4(-.213, -.215, .364, -.477, -.218, -.111, .141, -.462, .724, -.350, -.379, .120, -.372, .407, -.094, 1.104) * f0_0 + Mat4(-.065, .780, .630, -.243, .039, -.759, -.154, .121, -.828, .536, .678, -.823, .513, .830, -.145, .553) * f0_1 + Mat4(.764, .387, .054, -.431, -.049, .524, .044, .891, -.159, .182, .217, .611, .119, -.355, .228, .030) * f0_2 + Mat4(.526, .020, -.521, -.366, -.465, .357, .082, -.368, .160, .649, -.506, -.260, .154, .482, .222, .393) * f0_3 + Vec4(-.538, .688, -1.270, .721)) / 1.0 + f0_1;
-			Vec4 f1_2 = sin(Mat4(-.587, -.235, .031, -.583, .384, .405, .167, .339, .778, -.499, -.311, -.154, -.279, 1.064, -.609, -.058) * f0_0 + Mat4(-.191, .059, .284, .086, -.658, .495, -.015, -.757, 1.143, .597, .475, .298, -.124, -.505, -.401, -.212) * f0_1 + Mat4(.221, .421, -.376, .462, .568, .661, .542, -.524, .471, -.726, -.520, .528, .069, .454, .352, .780) * f0_2 + Mat4(.359, -.025, -.730, -.488, -.865, -.103, -.015, .098, .592, .204, .398, -.472, .072, .396, -.346, -.258) * f0_3 + Vec4(3.503, 3.117, 1.734, -2.248)) / 1.0 + f0_2;
-			Vec4 f1_3 = sin(Mat4(-.786, .057, .116, .141, -.233, -.241, .325, -.200, .092, -.531, -.053, .152, -.605, -.351, .413, -.274) * f0_0 + Mat4(.104, -.249, .320, -.261, -.095, .060, .786, -.063, -.070, -.468, .052, -.558, -.557, .009, -.192, .280) * f0_1 + Mat4(-.664, .297, -.124, .113, -.284, .734, .425, -.340, .081, -.133, -.049, -.209, -.310, .368, -.003, -.391) * f0_2 + Mat4(.015, -.185, .427, -.442, .191, .139, -.420, -.262, .254, -.068, .632, .151, .395, -.000, .067, .670) * f0_3 + Vec4(-3.185, 1.715, 3.541, 1.726)) / 1.0 + f0_3;
-			Vec4 f2_0 = sin(Mat4(-.876, -.128, .620, -.979, -.052, .201, .492, .232, -.393, -1.020, -.527, -.172, -.143, .127, .526, .223) * f1_0 + Mat4(.643, .102, 1.161, -.555, -.587, -1.253, .246, -.111, .884, -.944, -.620, .048, .468, -.753, -.040, -.534) * f1_1 + Mat4(.257, -.309, .046, .005, -.313, 1.355, -.042, -.088, -.046, -.452, .437, .431, .142, -.044, .253, -.020) * f1_2 + Mat4(-.040, .884, -.167, .816, -.312, -.448, -.929, .809, .502, .072, .851, -1.144, .023, .736, -.080, .056) * f1_3 + Vec4(3.092, -.379, -.619, 3.235)) / 1.4 + f1_0;
-			Vec4 f2_1 = sin(Mat4(.324, -.439, -.328, -.771, -.307, -.151, .168, .269, -.978, -1.237, .658, -.216, .229, -.954, -.225, -.464) * f1_0 + Mat4(.514, .160, -.566, -.157, -.830, -.443, -.369, -.660, -1.208, 1.357, .158, .107, .275, -.202, -.144, .006) * f1_1 + Mat4(.757, -.337, -.144, -1.115, .723, .438, -.499, -.044, .046, -.262, .427, -.044, .183, .316, -.389, -.124) * f1_2 + Mat4(-1.063, .047, -.112, .194, .351, -.459, -.209, -.313, -1.771, .433, -.779, .359, .213, .522, -.227, .788) * f1_3 + Vec4(-1.385, -.939, -2.511, -.512)) / 1.4 + f1_1;
-			Vec4 f2_2 = sin(Mat4(.562, .796, .458, -.584, -1.463, .710, .360, .128, .025, .451, -.141, .300, .276, .329, -.382, -.444) * f1_0 + Mat4(.377, .319, -.050, .104, .513, -.419, -.201, -.242, .129, .014, -.087, .316, -.012, -.618, -.390, -.426) * f1_1 + Mat4(.299, -.244, .703, -.758, .281, -.135, .835, .354, .241, -.139, .414, .848, -.815, .236, .800, .217) * f1_2 + Mat4(.591, -.381, .696, .199, -.191, -.221, .618, -.531, -.554, .518, -.982, -.010, .194, .181, .784, -1.140) * f1_3 + Vec4(3.316, .154, 1.061, 2.237)) / 1.4 + f1_2;
-			Vec4 f2_3 = sin(Mat4(.052, -.589, -1.287, -.338, -.999, .079, .048, .152, -.585, .255, -.721, -.240, -.659, .360, -.016, -.408) * f1_0 + Mat4(.186, .057, -.968, .225, .450, -1.048, -.710, .375, .821, -.730, -.037, .656, .333, .159, .292, .066) * f1_1 + Mat4(.296, .372, -.202, -.562, .510, .041, .037, -.401, -.064, -.203, -.500, -.026, -.587, -.020, .603, -.177) * f1_2 + Mat4(.758, .219, .271, -.131, -.116, -.485, .337, .013, -.380, -.716, -.644, .468, -.297, .552, 1.275, -.132) * f1_3 + Vec4(2.659, .165, -2.731, 2.476)) / 1.4 + f1_3;
-			return dot(f2_0, Vec4(.062, -.040, -.074, -.047)) + dot(f2_1, Vec4(-.057, -.039, -.071, -.057)) + dot(f2_2, Vec4(-.025, -.054, .044, .045)) + dot(f2_3, Vec4(.048, .066, -.058, .100)) + 0.102;
+			static constexpr Real scale = 0.0005;
+			CAGE_ASSERT(positions.size() == results.size());
+			const uint32 total = numeric_cast<uint32>(positions.size());
+			for (uint32 offset = 0; offset < total; offset += DenseSineNetwork::BlockSize)
+			{
+				const uint32 cnt = min(total - offset, DenseSineNetwork::BlockSize);
+				Vec3 ps[DenseSineNetwork::BlockSize];
+				for (uint32 i = 0; i < cnt; i++)
+				{
+					const Vec3 &p = positions[offset + i];
+					ps[i] = Vec3(p[0], p[2], p[1]) * scale;
+				}
+				const PointerRange<Real> rs = { results.data() + offset, results.data() + offset + cnt };
+				dense.evaluate({ ps, ps + cnt }, rs);
+				for (Real &r : rs)
+					r /= scale;
+			}
 		}
 	}
 
 	Real sdfBunny(const Vec3 &p)
 	{
 		static constexpr Real scale = 0.0005;
-		return sdfBunnyImpl(Vec3(p[0], p[2], p[1]) * scale) / scale;
+		return bunnyNetwork.evaluate(Vec3(p[0], p[2], p[1]) * scale) / scale;
 	}
 
 	Real sdfMonkeyHead(const Vec3 &p)
 	{
 		static constexpr Real scale = 0.0005;
-		return sdfMonkeyHeadImpl(Vec3(p[0], p[2], p[1]) * scale) / scale;
+		return monkeyHeadNetwork.evaluate(Vec3(p[0], p[2], p[1]) * scale) / scale;
 	}
 
 	Real sdfDoubleTorus(const Vec3 &p)
@@ -330,7 +567,7 @@ namespace unnatural
 		return -(sdfBox(p, Vec3(1300)) - 200);
 	}
 
-	Real sdfAsteroid(const Vec3 &p)
+	void sdfAsteroid(PointerRange<const Vec3> positions, PointerRange<Real> results)
 	{
 		static const Holder<NoiseFunction> shapeNoise = []()
 		{
@@ -344,12 +581,34 @@ namespace unnatural
 			return newNoiseFunction(cfg);
 		}();
 
-		const Real l = length(p);
-		if (l < 1)
-			return -100;
-		const Vec3 d = p / l;
-		const Real n = shapeNoise->evaluate(d);
-		return l + n * 600 - 1300;
+		CAGE_ASSERT(positions.size() == results.size());
+		static constexpr uint32 BatchSize = 512; // limits the temporary memory allocated on stack
+		const uint32 total = numeric_cast<uint32>(positions.size());
+		Vec3 *const dirs = (Vec3 *)CAGE_ALLOCA(min(total, BatchSize) * sizeof(Vec3));
+		for (uint32 offset = 0; offset < total; offset += BatchSize)
+		{
+			const uint32 cnt = min(total - offset, BatchSize);
+			const Vec3 *ps = positions.data() + offset;
+			Real *rs = results.data() + offset;
+			for (uint32 i = 0; i < cnt; i++)
+			{
+				const Real l = length(ps[i]);
+				dirs[i] = l < 1 ? Vec3(0, 0, 1) : ps[i] / l;
+			}
+			shapeNoise->evaluate({ dirs, dirs + cnt }, { rs, rs + cnt });
+			for (uint32 i = 0; i < cnt; i++)
+			{
+				const Real l = length(ps[i]);
+				rs[i] = l < 1 ? Real(-100) : l + rs[i] * 600 - 1300;
+			}
+		}
+	}
+
+	Real sdfAsteroid(const Vec3 &p)
+	{
+		Real result;
+		sdfAsteroid({ &p, &p + 1 }, { &result, &result + 1 });
+		return result;
 	}
 
 	Real sdfPipe(const Vec3 &p_)
@@ -402,4 +661,432 @@ namespace unnatural
 		const Real y = p[1];
 		return 700 - length(Vec2(x, y));
 	}
+
+	void sdfBelt(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfBelt>(positions, results);
+	}
+
+	void sdfBowl(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfBowl>(positions, results);
+	}
+
+	void sdfBox(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfBox>(positions, results);
+	}
+
+	void sdfBunny(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfNetworkBatch(denseBunnyNetwork(), positions, results);
+	}
+
+	void sdfCapsule(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfCapsule>(positions, results);
+	}
+
+	void sdfCube(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfCube>(positions, results);
+	}
+
+	void sdfDisk(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfDisk>(positions, results);
+	}
+
+	void sdfDoubleTorus(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfDoubleTorus>(positions, results);
+	}
+
+	void sdfFibers(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfFibers>(positions, results);
+	}
+
+	void sdfGear(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfGear>(positions, results);
+	}
+
+	void sdfH2O(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfH2O>(positions, results);
+	}
+
+	void sdfH3O(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfH3O>(positions, results);
+	}
+
+	void sdfH4O(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfH4O>(positions, results);
+	}
+
+	void sdfHemispheres(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfHemispheres>(positions, results);
+	}
+
+	void sdfHexagon(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfHexagon>(positions, results);
+	}
+
+	void sdfHexagonalPrism(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfHexagonalPrism>(positions, results);
+	}
+
+	void sdfInsideCube(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfInsideCube>(positions, results);
+	}
+
+	void sdfKnot(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfKnot>(positions, results);
+	}
+
+	void sdfMandelbulb(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfMandelbulb>(positions, results);
+	}
+
+	void sdfMobiusStrip(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfMobiusStrip>(positions, results);
+	}
+
+	void sdfMonkeyHead(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfNetworkBatch(denseMonkeyHeadNetwork(), positions, results);
+	}
+
+	void sdfOctahedron(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfOctahedron>(positions, results);
+	}
+
+	void sdfPipe(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfPipe>(positions, results);
+	}
+
+	void sdfSphere(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfSphere>(positions, results);
+	}
+
+	void sdfSquare(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfSquare>(positions, results);
+	}
+
+	void sdfTetrahedron(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfTetrahedron>(positions, results);
+	}
+
+	void sdfTorus(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfTorus>(positions, results);
+	}
+
+	void sdfTorusCross(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfTorusCross>(positions, results);
+	}
+
+	void sdfTriangularPrism(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfTriangularPrism>(positions, results);
+	}
+
+	void sdfTube(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfTube>(positions, results);
+	}
+
+	void sdfTwistedHexagonalPrism(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfTwistedHexagonalPrism>(positions, results);
+	}
+
+	void sdfTwistedPlane(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfTwistedPlane>(positions, results);
+	}
+
+	void sdfWormhole(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		sdfBatch<&sdfWormhole>(positions, results);
+	}
+
+	namespace
+	{
+		// gradients of the primitives from cage, in their own coordinate systems
+
+		Vec3 boxGradient(const Vec3 &p, const Vec3 &radius)
+		{
+			const Vec3 q = abs(p) - radius;
+			Vec3 g;
+			if (q[0] > 0 || q[1] > 0 || q[2] > 0)
+				g = normalize(max(q, 0));
+			else
+			{
+				const uint32 a = q[0] > q[1] ? (q[0] > q[2] ? 0 : 2) : (q[1] > q[2] ? 1 : 2);
+				g[a] = 1;
+			}
+			for (uint32 i = 0; i < 3; i++)
+				if (p[i] < 0)
+					g[i] = -g[i];
+			return g;
+		}
+
+		Vec3 cylinderGradient(const Vec3 &p, Real halfHeight, Real radius)
+		{
+			const Real r = length(Vec2(p[0], p[1]));
+			const Vec2 d = Vec2(r - radius, abs(p[2]) - halfHeight);
+			Vec2 g;
+			if (d[0] > 0 || d[1] > 0)
+				g = normalize(max(d, 0));
+			else if (d[0] > d[1])
+				g = Vec2(1, 0);
+			else
+				g = Vec2(0, 1);
+			const Vec2 radial = r > 1e-6 ? Vec2(p[0], p[1]) / r : Vec2();
+			return Vec3(radial * g[0], p[2] < 0 ? -g[1] : g[1]);
+		}
+
+		Vec3 capsuleGradient(const Vec3 &pos, Real prolong)
+		{
+			Vec3 p = pos;
+			p[2] -= clamp(p[2], -prolong * 0.5, prolong * 0.5);
+			const Real l = length(p);
+			return l > 1e-6 ? p / l : Vec3();
+		}
+
+		Vec3 swapYZ(const Vec3 &v)
+		{
+			return Vec3(v[0], v[2], v[1]);
+		}
+	}
+
+	Vec3 sdfBowlGradient(const Vec3 &p)
+	{
+		const Vec3 d = p - Vec3(0, 0, -3000);
+		const Real l = length(d);
+		return l > 1e-6 ? -d / l : Vec3();
+	}
+
+	Vec3 sdfBoxGradient(const Vec3 &pos)
+	{
+		return boxGradient(pos, Vec3(550, 1000, 550));
+	}
+
+	Vec3 sdfCapsuleGradient(const Vec3 &pos)
+	{
+		return swapYZ(capsuleGradient(swapYZ(pos), 2500));
+	}
+
+	Vec3 sdfCubeGradient(const Vec3 &pos)
+	{
+		return boxGradient(pos, Vec3(450));
+	}
+
+	Vec3 sdfDiskGradient(const Vec3 &pos)
+	{
+		return cylinderGradient(pos, 200, 600);
+	}
+
+	Vec3 sdfHexagonGradient(const Vec3 &pos)
+	{
+		return normalize(Vec3(1, 1, -1));
+	}
+
+	Vec3 sdfOctahedronGradient(const Vec3 &pos)
+	{
+		static constexpr Real radius = 800;
+		const Vec3 p = abs(pos);
+		const Real m = p[0] + p[1] + p[2] - radius;
+		Vec3 g;
+		// the rotation of the axes brings the nearest edge into a common position
+		uint32 r = 3;
+		if (3 * p[0] < m)
+			r = 0;
+		else if (3 * p[1] < m)
+			r = 1;
+		else if (3 * p[2] < m)
+			r = 2;
+		if (r == 3)
+			g = Vec3(1) / sqrt(3);
+		else
+		{
+			const Vec3 q = Vec3(p[r], p[(r + 1) % 3], p[(r + 2) % 3]);
+			const Real k = clamp(0.5 * (q[2] - q[1] + radius), 0, radius);
+			const Vec3 v = Vec3(q[0], q[1] - radius + k, q[2] - k);
+			const Real l = length(v);
+			if (l < 1e-6)
+				return Vec3();
+			for (uint32 i = 0; i < 3; i++)
+				g[(r + i) % 3] = v[i] / l;
+		}
+		for (uint32 i = 0; i < 3; i++)
+			if (pos[i] < 0)
+				g[i] = -g[i];
+		return g;
+	}
+
+	Vec3 sdfSphereGradient(const Vec3 &pos)
+	{
+		const Real l = length(pos);
+		return l > 1e-6 ? pos / l : Vec3();
+	}
+
+	Vec3 sdfSquareGradient(const Vec3 &pos)
+	{
+		return Vec3(0, 0, -1);
+	}
+
+	Vec3 sdfTetrahedronGradient(const Vec3 &p)
+	{
+		// the distance is the larger of two pairs of planes, each pair folded by the absolute value
+		const Real a = abs(p[0] + p[1]) - p[2];
+		const Real b = abs(p[0] - p[1]) + p[2];
+		Vec3 g;
+		if (a > b)
+		{
+			const Real s = p[0] + p[1] < 0 ? -1 : 1;
+			g = Vec3(s, s, -1);
+		}
+		else
+		{
+			const Real s = p[0] - p[1] < 0 ? -1 : 1;
+			g = Vec3(s, -s, 1);
+		}
+		return g / sqrt(3);
+	}
+
+	Vec3 sdfTorusGradient(const Vec3 &p)
+	{
+		const Real r = length(Vec2(p[0], p[1]));
+		const Vec2 q = Vec2(r - 950, p[2]);
+		const Real l = length(q);
+		if (l < 1e-6)
+			return Vec3();
+		const Vec2 radial = r > 1e-6 ? Vec2(p[0], p[1]) / r : Vec2();
+		return Vec3(radial * (q[0] / l), q[1] / l);
+	}
+
+	Vec3 sdfTriangularPrismGradient(const Vec3 &pos)
+	{
+		static constexpr Real height = 300;
+		static constexpr Real radius = 900;
+		const Triangle t = Triangle(Vec3(0, radius, 0), Vec3(0, radius, 0) * Quat(Degs(), Degs(), Degs(120)), Vec3(0, radius, 0) * Quat(Degs(), Degs(), Degs(-120)));
+		const Vec3 l = swapYZ(pos);
+		Vec3 p = l;
+		p[2] = max(abs(p[2]) - height * 0.5, 0);
+		Vec3 v = p - closestPoint(t, p);
+		const Real d = length(v);
+		if (d < 1e-6)
+			return Vec3(); // inside the core prism the unsigned distance is flat
+		if (l[2] < 0)
+			v[2] = -v[2];
+		return swapYZ(v / d);
+	}
+
+	Vec3 sdfTubeGradient(const Vec3 &pos)
+	{
+		return swapYZ(cylinderGradient(swapYZ(pos), 10000, 800));
+	}
+
+	Vec3 sdfWormholeGradient(const Vec3 &p)
+	{
+		const Real r = length(Vec2(p[0], p[2]));
+		const Real x = min(r - 1400, 0);
+		const Real y = p[1];
+		const Real l = length(Vec2(x, y));
+		if (l < 1e-6)
+			return Vec3();
+		const Vec3 dx = x < 0 && r > 1e-6 ? Vec3(p[0], 0, p[2]) / r : Vec3();
+		return -(x * dx + y * Vec3(0, 1, 0)) / l;
+	}
+
+	void sdfValidate()
+	{
+		// the batch networks differ from the scalar networks only in the order of the summation
+		static constexpr Real Tolerance = 0.01;
+		std::vector<Vec3> positions;
+		for (sint32 z = -12; z <= 12; z++)
+			for (sint32 y = -12; y <= 12; y++)
+				for (sint32 x = -12; x <= 12; x++)
+					positions.push_back(Vec3(x, y, z) * 200 + Vec3(7, 13, 3));
+		std::vector<Real> results;
+		results.resize(positions.size());
+		const auto &check = [&](const char *name, Real (*scalar)(const Vec3 &), void (*batch)(PointerRange<const Vec3>, PointerRange<Real>))
+		{
+			batch(positions, results);
+			for (uint32 i = 0; i < positions.size(); i++)
+			{
+				const Real s = scalar(positions[i]);
+				if (abs(s - results[i]) > Tolerance)
+				{
+					CAGE_LOG_THROW(Stringizer() + "function: " + name + ", position: " + positions[i] + ", scalar: " + s + ", batch: " + results[i]);
+					CAGE_THROW_ERROR(Exception, "batch sdf differs from the scalar sdf");
+				}
+			}
+		};
+		check("bunny", &sdfBunny, &sdfBunny);
+		check("monkeyhead", &sdfMonkeyHead, &sdfMonkeyHead);
+
+		// the analytic gradients are compared with central differences, except on creases where two step sizes disagree
+		const auto &differences = [](Real (*fnc)(const Vec3 &), const Vec3 &p, Real step) -> Vec3
+		{
+			Vec3 g;
+			for (uint32 i = 0; i < 3; i++)
+			{
+				Vec3 d;
+				d[i] = step;
+				g[i] = (fnc(p + d) - fnc(p - d)) / (2 * step);
+			}
+			return g;
+		};
+		const auto &checkGradient = [&](const char *name, Real (*fnc)(const Vec3 &), Vec3 (*gradient)(const Vec3 &))
+		{
+			for (const Vec3 &p : positions)
+			{
+				const Vec3 a = gradient(p);
+				if (lengthSquared(a) < 1e-6)
+					continue; // flat region or a singular point
+				const Vec3 coarse = differences(fnc, p, 2);
+				const Vec3 fine = differences(fnc, p, 0.5);
+				if (distance(coarse, fine) > 0.01)
+					continue; // crease
+				if (distance(a, fine) > 0.02)
+				{
+					CAGE_LOG_THROW(Stringizer() + "function: " + name + ", position: " + p + ", analytic: " + a + ", differences: " + fine);
+					CAGE_THROW_ERROR(Exception, "analytic sdf gradient differs from the central differences");
+				}
+			}
+		};
+		checkGradient("bowl", &sdfBowl, &sdfBowlGradient);
+		checkGradient("box", &sdfBox, &sdfBoxGradient);
+		checkGradient("capsule", &sdfCapsule, &sdfCapsuleGradient);
+		checkGradient("cube", &sdfCube, &sdfCubeGradient);
+		checkGradient("disk", &sdfDisk, &sdfDiskGradient);
+		checkGradient("hexagon", &sdfHexagon, &sdfHexagonGradient);
+		checkGradient("octahedron", &sdfOctahedron, &sdfOctahedronGradient);
+		checkGradient("sphere", &sdfSphere, &sdfSphereGradient);
+		checkGradient("square", &sdfSquare, &sdfSquareGradient);
+		checkGradient("tetrahedron", &sdfTetrahedron, &sdfTetrahedronGradient);
+		checkGradient("torus", &sdfTorus, &sdfTorusGradient);
+		checkGradient("triangularprism", &sdfTriangularPrism, &sdfTriangularPrismGradient);
+		checkGradient("tube", &sdfTube, &sdfTubeGradient);
+		checkGradient("wormhole", &sdfWormhole, &sdfWormholeGradient);
+	}
 }
@@ -41,6 +41,65 @@ namespace unnatural
 	Real sdfTwistedHexagonalPrism(const Vec3 &pos);
 	Real sdfTwistedPlane(const Vec3 &p);
 	Real sdfWormhole(const Vec3 &p);
+
+	// batch variants
+	void sdfAsteroid(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfBelt(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfBowl(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfBox(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfBunny(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfCapsule(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfCube(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfDisk(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfDoubleTorus(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfFibers(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfGear(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfH2O(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfH3O(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfH4O(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfHemispheres(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfHexagon(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfHexagonalPrism(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfInsideCube(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfKnot(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfMandelbulb(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfMobiusStrip(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfMonkeyHead(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfOctahedron(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfPipe(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfSphere(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfSquare(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfTetrahedron(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfTorus(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfTorusCross(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfTriangularPrism(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfTube(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfTwistedHexagonalPrism(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfTwistedPlane(PointerRange<const Vec3> positions, PointerRange<Real> results);
+	void sdfWormhole(PointerRange<const Vec3> positions, PointerRange<Real> results);
+
+	// shapes described by expression files
+	void sdfExpressionLoad(const String &path);
+	Real sdfExpressionLipschitz();
+	bool sdfExpressionDoubleSided();
+	Real sdfExpression(const Vec3 &p);
+	void sdfExpression(PointerRange<const Vec3> positions, PointerRange<Real> results);
+
+	// analytic gradients
+	Vec3 sdfBowlGradient(const Vec3 &p);
+	Vec3 sdfBoxGradient(const Vec3 &pos);
+	Vec3 sdfCapsuleGradient(const Vec3 &pos);
+	Vec3 sdfCubeGradient(const Vec3 &pos);
+	Vec3 sdfDiskGradient(const Vec3 &pos);
+	Vec3 sdfHexagonGradient(const Vec3 &pos);
+	Vec3 sdfOctahedronGradient(const Vec3 &pos);
+	Vec3 sdfSphereGradient(const Vec3 &pos);
+	Vec3 sdfSquareGradient(const Vec3 &pos);
+	Vec3 sdfTetrahedronGradient(const Vec3 &p);
+	Vec3 sdfTorusGradient(const Vec3 &p);
+	Vec3 sdfTriangularPrismGradient(const Vec3 &pos);
+	Vec3 sdfTubeGradient(const Vec3 &pos);
+	Vec3 sdfWormholeGradient(const Vec3 &p);
 }
 
 #endif
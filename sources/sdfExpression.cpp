@@ -0,0 +1,765 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fastMath.h"
+#include "sdf.h"
+
+#include <cage-core/files.h>
+#include <cage-core/noiseFunction.h>
+#include <cage-core/string.h>
+
+// shapes described by expression files
+//
+// each statement assigns an expression to a variable, statements are separated by new lines or semicolons
+// variables x, y, z hold the position, the shape is the value of variable sdf
+// expressions use numbers, variables, + - * /, parentheses and the functions listed below
+// noise(x, y, z, frequency, octaves) is simplex fbm, its frequency and octaves must be numbers
+// optional properties (numbers only): lipschitz (upper bound of the gradient magnitude, enables skipping empty space), doublesided (non-zero for open shapes)
+// comments start with #
+
+namespace unnatural
+{
+	namespace
+	{
+		enum class OpcodeEnum : uint8
+		{
+			Constant,
+			Load,
+			Store,
+			Add,
+			Subtract,
+			Multiply,
+			Divide,
+			Negate,
+			Abs,
+			Sqrt,
+			Floor,
+			Sin,
+			Cos,
+			Min,
+			Max,
+			Clamp,
+			Length2,
+			Length3,
+			SmoothMin,
+			SmoothMax,
+			Sphere,
+			Box,
+			Torus,
+			Noise,
+		};
+
+		struct Instruction
+		{
+			OpcodeEnum op = OpcodeEnum::Constant;
+			uint32 arg = 0;
+		};
+
+		struct FunctionDefinition
+		{
+			const char *name = nullptr;
+			OpcodeEnum op = OpcodeEnum::Constant;
+			uint32 arguments = 0;
+		};
+
+		constexpr FunctionDefinition functionDefinitions[] = {
+			{ "abs", OpcodeEnum::Abs, 1 },
+			{ "sqrt", OpcodeEnum::Sqrt, 1 },
+			{ "floor", OpcodeEnum::Floor, 1 },
+			{ "sin", OpcodeEnum::Sin, 1 },
+			{ "cos", OpcodeEnum::Cos, 1 },
+			{ "min", OpcodeEnum::Min, 2 },
+			{ "max", OpcodeEnum::Max, 2 },
+			{ "clamp", OpcodeEnum::Clamp, 3 },
+			{ "length", OpcodeEnum::Length2, 2 },
+			{ "length", OpcodeEnum::Length3, 3 },
+			{ "smin", OpcodeEnum::SmoothMin, 3 }, // a, b, k
+			{ "smax", OpcodeEnum::SmoothMax, 3 }, // a, b, k
+			{ "sphere", OpcodeEnum::Sphere, 4 }, // x, y, z, radius
+			{ "box", OpcodeEnum::Box, 6 }, // x, y, z, half sizes
+			{ "torus", OpcodeEnum::Torus, 5 }, // x, y, z, major radius, minor radius; around the z axis
+		};
+
+		struct Program
+		{
+			static constexpr uint32 BlockSize = 256;
+
+			std::vector<Instruction> code;
+			std::vector<float> constants;
+			std::vector<Holder<NoiseFunction>> noises;
+			uint32 variables = 3; // x, y, z
+			uint32 stackSize = 0;
+			uint32 result = m;
+			Real lipschitz = Real::Infinity();
+			bool doubleSided = false;
+
+			void evaluate(PointerRange<const Vec3> positions, PointerRange<Real> results) const
+			{
+				CAGE_ASSERT(positions.size() == results.size());
+				CAGE_ASSERT(result != m);
+				thread_local std::vector<float> scratch;
+				thread_local std::vector<Vec3> noisePositions;
+				thread_local std::vector<Real> noiseResults;
+				scratch.resize((variables + stackSize) * BlockSize);
+
+				const uint32 total = numeric_cast<uint32>(positions.size());
+				for (uint32 offset = 0; offset < total; offset += BlockSize)
+				{
+					const uint32 n = min(total - offset, BlockSize);
+					const auto &var = [&](uint32 i) -> float * { return scratch.data() + i * BlockSize; };
+					const auto &slot = [&](uint32 i) -> float * { return scratch.data() + (variables + i) * BlockSize; };
+
+					for (uint32 i = 0; i < n; i++)
+					{
+						const Vec3 &p = positions[offset + i];
+						var(0)[i] = p[0].value;
+						var(1)[i] = p[1].value;
+						var(2)[i] = p[2].value;
+					}
+
+					// sp is the number of occupied stack slots
+					// every instruction is a loop over the whole block so that the compiler can vectorize it
+					uint32 sp = 0;
+					for (const Instruction &ins : code)
+					{
+						switch (ins.op)
+						{
+							case OpcodeEnum::Constant:
+							{
+								float *a = slot(sp++);
+								const float c = constants[ins.arg];
+								for (uint32 i = 0; i < n; i++)
+									a[i] = c;
+								break;
+							}
+							case OpcodeEnum::Load:
+							{
+								float *a = slot(sp++);
+								const float *v = var(ins.arg);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = v[i];
+								break;
+							}
+							case OpcodeEnum::Store:
+							{
+								const float *a = slot(--sp);
+								float *v = var(ins.arg);
+								for (uint32 i = 0; i < n; i++)
+									v[i] = a[i];
+								break;
+							}
+							case OpcodeEnum::Add:
+							{
+								sp--;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								for (uint32 i = 0; i < n; i++)
+									a[i] += b[i];
+								break;
+							}
+							case OpcodeEnum::Subtract:
+							{
+								sp--;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								for (uint32 i = 0; i < n; i++)
+									a[i] -= b[i];
+								break;
+							}
+							case OpcodeEnum::Multiply:
+							{
+								sp--;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								for (uint32 i = 0; i < n; i++)
+									a[i] *= b[i];
+								break;
+							}
+							case OpcodeEnum::Divide:
+							{
+								sp--;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								for (uint32 i = 0; i < n; i++)
+									a[i] /= b[i];
+								break;
+							}
+							case OpcodeEnum::Negate:
+							{
+								float *a = slot(sp - 1);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = -a[i];
+								break;
+							}
+							case OpcodeEnum::Abs:
+							{
+								float *a = slot(sp - 1);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = std::abs(a[i]);
+								break;
+							}
+							case OpcodeEnum::Sqrt:
+							{
+								float *a = slot(sp - 1);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = std::sqrt(a[i]);
+								break;
+							}
+							case OpcodeEnum::Floor:
+							{
+								float *a = slot(sp - 1);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = std::floor(a[i]);
+								break;
+							}
+							case OpcodeEnum::Sin:
+							{
+								float *a = slot(sp - 1);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = fastSin(Rads(a[i])).value;
+								break;
+							}
+							case OpcodeEnum::Cos:
+							{
+								float *a = slot(sp - 1);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = fastCos(Rads(a[i])).value;
+								break;
+							}
+							case OpcodeEnum::Min:
+							{
+								sp--;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = a[i] < b[i] ? a[i] : b[i];
+								break;
+							}
+							case OpcodeEnum::Max:
+							{
+								sp--;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = a[i] > b[i] ? a[i] : b[i];
+								break;
+							}
+							case OpcodeEnum::Clamp:
+							{
+								sp -= 2;
+								float *a = slot(sp - 1);
+								const float *lo = slot(sp);
+								const float *hi = slot(sp + 1);
+								for (uint32 i = 0; i < n; i++)
+								{
+									const float t = a[i] < lo[i] ? lo[i] : a[i];
+									a[i] = t > hi[i] ? hi[i] : t;
+								}
+								break;
+							}
+							case OpcodeEnum::Length2:
+							{
+								sp--;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = std::sqrt(a[i] * a[i] + b[i] * b[i]);
+								break;
+							}
+							case OpcodeEnum::Length3:
+							{
+								sp -= 2;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								const float *c = slot(sp + 1);
+								for (uint32 i = 0; i < n; i++)
+									a[i] = std::sqrt(a[i] * a[i] + b[i] * b[i] + c[i] * c[i]);
+								break;
+							}
+							case OpcodeEnum::SmoothMin:
+							case OpcodeEnum::SmoothMax:
+							{
+								// same as smoothMin and smoothMax in math.h
+								sp -= 2;
+								float *a = slot(sp - 1);
+								const float *b = slot(sp);
+								const float *k = slot(sp + 1);
+								const float s = ins.op == OpcodeEnum::SmoothMin ? 1 : -1;
+								for (uint32 i = 0; i < n; i++)
+								{
+									const float aa = a[i] * s;
+									const float bb = b[i] * s;
+									float h = (bb - aa) / k[i] * 0.5f + 0.5f;
+									h = h < 0 ? 0 : h > 1 ? 1 : h;
+									a[i] = (bb + (aa - bb) * h - k[i] * h * (1 - h)) * s;
+								}
+								break;
+							}
+							case OpcodeEnum::Sphere:
+							{
+								sp -= 3;
+								float *x = slot(sp - 1);
+								const float *y = slot(sp);
+								const float *z = slot(sp + 1);
+								const float *r = slot(sp + 2);
+								for (uint32 i = 0; i < n; i++)
+									x[i] = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]) - r[i];
+								break;
+							}
+							case OpcodeEnum::Box:
+							{
+								sp -= 5;
+								float *x = slot(sp - 1);
+								const float *y = slot(sp);
+								const float *z = slot(sp + 1);
+								const float *hx = slot(sp + 2);
+								const float *hy = slot(sp + 3);
+								const float *hz = slot(sp + 4);
+								for (uint32 i = 0; i < n; i++)
+								{
+									const float qx = std::abs(x[i]) - hx[i];
+									const float qy = std::abs(y[i]) - hy[i];
+									const float qz = std::abs(z[i]) - hz[i];
+									const float ox = qx > 0 ? qx : 0;
+									const float oy = qy > 0 ? qy : 0;
+									const float oz = qz > 0 ? qz : 0;
+									const float mq = qx > qy ? (qx > qz ? qx : qz) : (qy > qz ? qy : qz);
+									x[i] = std::sqrt(ox * ox + oy * oy + oz * oz) + (mq < 0 ? mq : 0);
+								}
+								break;
+							}
+							case OpcodeEnum::Torus:
+							{
+								sp -= 4;
+								float *x = slot(sp - 1);
+								const float *y = slot(sp);
+								const float *z = slot(sp + 1);
+								const float *major = slot(sp + 2);
+								const float *minor = slot(sp + 3);
+								for (uint32 i = 0; i < n; i++)
+								{
+									const float q = std::sqrt(x[i] * x[i] + y[i] * y[i]) - major[i];
+									x[i] = std::sqrt(q * q + z[i] * z[i]) - minor[i];
+								}
+								break;
+							}
+							case OpcodeEnum::Noise:
+							{
+								sp -= 2;
+								float *x = slot(sp - 1);
+								const float *y = slot(sp);
+								const float *z = slot(sp + 1);
+								noisePositions.resize(n);
+								noiseResults.resize(n);
+								for (uint32 i = 0; i < n; i++)
+									noisePositions[i] = Vec3(x[i], y[i], z[i]);
+								noises[ins.arg]->evaluate(noisePositions, noiseResults);
+								for (uint32 i = 0; i < n; i++)
+									x[i] = noiseResults[i].value;
+								break;
+							}
+						}
+					}
+					CAGE_ASSERT(sp == 0);
+
+					const float *r = var(result);
+					for (uint32 i = 0; i < n; i++)
+						results[offset + i] = r[i];
+				}
+			}
+		};
+
+		enum class TokenEnum : uint8
+		{
+			End,
+			Separator, // new line or semicolon
+			Number,
+			Identifier,
+			Symbol,
+		};
+
+		struct Parser
+		{
+			Program &program;
+			std::string_view source;
+			std::vector<std::string> names = { "x", "y", "z" };
+			std::size_t position = 0;
+			uint32 line = 1;
+			uint32 depth = 0;
+			uint32 nesting = 0; // recursion depth of the parser itself, limited to protect the stack
+
+			static constexpr uint32 MaxNesting = 200;
+
+			TokenEnum token = TokenEnum::End;
+			std::string_view text;
+			float number = 0;
+
+			Parser(Program &program, std::string_view source) : program(program), source(source) { next(); }
+
+			[[noreturn]] void error(const char *message)
+			{
+				CAGE_LOG_THROW(Stringizer() + "line: " + line + ", near: '" + String(std::string(text).c_str()) + "'");
+				CAGE_THROW_ERROR(Exception, message);
+			}
+
+			void next()
+			{
+				while (position < source.size())
+				{
+					const char c = source[position];
+					if (c == '#')
+					{
+						while (position < source.size() && source[position] != '\n')
+							position++;
+					}
+					else if (c == ' ' || c == '\t' || c == '\r')
+						position++;
+					else
+						break;
+				}
+				if (position >= source.size())
+				{
+					token = TokenEnum::End;
+					text = {};
+					return;
+				}
+				const std::size_t start = position;
+				const char c = source[position];
+				if (c == '\n' || c == ';')
+				{
+					if (c == '\n')
+						line++;
+					position++;
+					token = TokenEnum::Separator;
+				}
+				else if ((c >= '0' && c <= '9') || c == '.')
+				{
+					const auto r = std::from_chars(source.data() + position, source.data() + source.size(), number);
+					if (r.ec != std::errc())
+					{
+						text = source.substr(start, 1);
+						error("invalid number in shape expression");
+					}
+					position = r.ptr - source.data();
+					token = TokenEnum::Number;
+				}
+				else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_')
+				{
+					while (position < source.size())
+					{
+						const char d = source[position];
+						if (!((d >= 'a' && d <= 'z') || (d >= 'A' && d <= 'Z') || (d >= '0' && d <= '9') || d == '_'))
+							break;
+						position++;
+					}
+					token = TokenEnum::Identifier;
+				}
+				else
+				{
+					position++;
+					token = TokenEnum::Symbol;
+				}
+				text = source.substr(start, position - start);
+			}
+
+			bool isSymbol(char c) const { return token == TokenEnum::Symbol && text[0] == c; }
+
+			void expectSymbol(char c, const char *message)
+			{
+				if (!isSymbol(c))
+					error(message);
+				next();
+			}
+
+			float expectNumber()
+			{
+				bool negative = false;
+				if (isSymbol('-'))
+				{
+					negative = true;
+					next();
+				}
+				if (token != TokenEnum::Number)
+					error("expected number in shape expression");
+				const float r = negative ? -number : number;
+				next();
+				return r;
+			}
+
+			void emit(OpcodeEnum op, uint32 arg, sint32 stackChange)
+			{
+				program.code.push_back({ op, arg });
+				depth += stackChange;
+				program.stackSize = max(program.stackSize, depth);
+			}
+
+			uint32 findVariable(std::string_view name) const
+			{
+				for (uint32 i = 0; i < names.size(); i++)
+					if (names[i] == name)
+						return i;
+				return m;
+			}
+
+			void call(std::string_view name)
+			{
+				next(); // (
+				if (name == "noise")
+				{
+					for (uint32 i = 0; i < 3; i++)
+					{
+						expression();
+						expectSymbol(',', "expected comma in noise arguments");
+					}
+					NoiseFunctionCreateConfig cfg;
+					cfg.type = NoiseTypeEnum::Simplex;
+					cfg.fractalType = NoiseFractalTypeEnum::Fbm;
+					cfg.frequency = expectNumber();
+					expectSymbol(',', "expected comma in noise arguments");
+					cfg.octaves = numeric_cast<uint32>(expectNumber());
+					cfg.seed = noiseSeed();
+					expectSymbol(')', "expected closing parenthesis");
+					program.noises.push_back(newNoiseFunction(cfg));
+					emit(OpcodeEnum::Noise, numeric_cast<uint32>(program.noises.size() - 1), -2);
+					return;
+				}
+				uint32 arguments = 0;
+				if (!isSymbol(')'))
+				{
+					while (true)
+					{
+						expression();
+						arguments++;
+						if (!isSymbol(','))
+							break;
+						next();
+					}
+				}
+				expectSymbol(')', "expected closing parenthesis");
+				for (const FunctionDefinition &f : functionDefinitions)
+				{
+					if (name == f.name && arguments == f.arguments)
+					{
+						emit(f.op, 0, 1 - (sint32)arguments);
+						return;
+					}
+				}
+				error("unknown function or wrong number of arguments in shape expression");
+			}
+
+			void primary()
+			{
+				switch (token)
+				{
+					case TokenEnum::Number:
+						program.constants.push_back(number);
+						emit(OpcodeEnum::Constant, numeric_cast<uint32>(program.constants.size() - 1), 1);
+						next();
+						return;
+					case TokenEnum::Identifier:
+					{
+						const std::string_view name = text;
+						next();
+						if (isSymbol('('))
+							return call(name);
+						const uint32 v = findVariable(name);
+						if (v == m)
+							error("unknown variable in shape expression");
+						emit(OpcodeEnum::Load, v, 1);
+						return;
+					}
+					default:
+						break;
+				}
+				if (isSymbol('('))
+				{
+					next();
+					expression();
+					expectSymbol(')', "expected closing parenthesis");
+					return;
+				}
+				error("unexpected token in shape expression");
+			}
+
+			// every recursion (parentheses, negations, function arguments) passes through here
+			void unary()
+			{
+				if (++nesting > MaxNesting)
+					error("shape expression is nested too deeply");
+				if (isSymbol('-'))
+				{
+					next();
+					unary();
+					emit(OpcodeEnum::Negate, 0, 0);
+				}
+				else
+					primary();
+				nesting--;
+			}
+
+			void term()
+			{
+				unary();
+				while (isSymbol('*') || isSymbol('/'))
+				{
+					const OpcodeEnum op = isSymbol('*') ? OpcodeEnum::Multiply : OpcodeEnum::Divide;
+					next();
+					unary();
+					emit(op, 0, -1);
+				}
+			}
+
+			void expression()
+			{
+				term();
+				while (isSymbol('+') || isSymbol('-'))
+				{
+					const OpcodeEnum op = isSymbol('+') ? OpcodeEnum::Add : OpcodeEnum::Subtract;
+					next();
+					term();
+					emit(op, 0, -1);
+				}
+			}
+
+			void statement()
+			{
+				if (token != TokenEnum::Identifier)
+					error("expected assignment in shape expression");
+				const std::string name = std::string(text);
+				next();
+				expectSymbol('=', "expected assignment in shape expression");
+				if (name == "lipschitz")
+					program.lipschitz = expectNumber();
+				else if (name == "doublesided")
+					program.doubleSided = expectNumber() != 0;
+				else
+				{
+					expression();
+					uint32 v = findVariable(name);
+					if (v == m)
+					{
+						v = numeric_cast<uint32>(names.size());
+						names.push_back(name);
+					}
+					emit(OpcodeEnum::Store, v, -1);
+					CAGE_ASSERT(depth == 0);
+				}
+				if (token != TokenEnum::Separator && token != TokenEnum::End)
+					error("unexpected token after statement in shape expression");
+			}
+
+			void parse()
+			{
+				while (token != TokenEnum::End)
+				{
+					if (token == TokenEnum::Separator)
+						next();
+					else
+						statement();
+				}
+				program.variables = numeric_cast<uint32>(names.size());
+				program.result = findVariable("sdf");
+				if (program.result == m)
+					error("shape expression does not assign sdf");
+			}
+		};
+
+		Program program;
+
+		Program load(const String &path)
+		{
+			Holder<PointerRange<char>> content = readFile(path)->readAll();
+			Program result;
+			Parser parser(result, std::string_view(content.data(), content.size()));
+			parser.parse();
+			return result;
+		}
+
+		// deterministic points spread over the generated volume
+		std::vector<Vec3> benchmarkPositions()
+		{
+			static constexpr uint32 Side = 40;
+			std::vector<Vec3> positions;
+			positions.reserve(Side * Side * Side);
+			for (uint32 z = 0; z < Side; z++)
+				for (uint32 y = 0; y < Side; y++)
+					for (uint32 x = 0; x < Side; x++)
+						positions.push_back((Vec3(x, y, z) / (Side - 1) * 2 - 1) * 2000);
+			return positions;
+		}
+
+		// nanoseconds per sample, the best of several repetitions after a warm-up run
+		template<class F>
+		Real measure(PointerRange<const Vec3> positions, PointerRange<Real> results, F &&fnc)
+		{
+			static constexpr uint32 Repetitions = 10;
+			fnc(positions, results);
+			double best = std::numeric_limits<double>::infinity();
+			for (uint32 i = 0; i < Repetitions; i++)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				fnc(positions, results);
+				const auto end = std::chrono::steady_clock::now();
+				best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+			}
+			return Real(best / positions.size());
+		}
+
+		// compares an expression with the built-in shape that it mirrors
+		void compare(const String &name, void (*builtin)(PointerRange<const Vec3>, PointerRange<Real>))
+		{
+			const String path = pathJoin(pathSearchTowardsRoot("shapes", PathTypeFlags::Directory), name);
+			const Program prog = load(path);
+			const std::vector<Vec3> positions = benchmarkPositions();
+			std::vector<Real> results;
+			results.resize(positions.size());
+			const Real expression = measure(positions, results, [&](PointerRange<const Vec3> p, PointerRange<Real> r) { prog.evaluate(p, r); });
+			const Real reference = measure(positions, results, builtin);
+			CAGE_LOG(SeverityEnum::Info, "selfTest", Stringizer() + "shape expression: " + name + ", " + prog.code.size() + " instructions, " + expression + " ns per sample, built-in: " + reference + " ns per sample, ratio: " + (expression / reference));
+		}
+	}
+
+	void sdfExpressionLoad(const String &path)
+	{
+		CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "loading shape expression: '" + path + "'");
+		program = load(path);
+		const std::vector<Vec3> positions = benchmarkPositions();
+		std::vector<Real> results;
+		results.resize(positions.size());
+		const Real expression = measure(positions, results, [](PointerRange<const Vec3> p, PointerRange<Real> r) { program.evaluate(p, r); });
+		CAGE_LOG(SeverityEnum::Info, "configuration", Stringizer() + "shape expression: " + program.code.size() + " instructions, " + expression + " ns per sample");
+	}
+
+	void sdfExpressionBenchmark()
+	{
+		compare("sphere.sdf", &sdfSphere);
+		compare("donut.sdf", &sdfTorus);
+	}
+
+	Real sdfExpressionLipschitz()
+	{
+		return program.lipschitz;
+	}
+
+	bool sdfExpressionDoubleSided()
+	{
+		return program.doubleSided;
+	}
+
+	Real sdfExpression(const Vec3 &p)
+	{
+		Real r;
+		program.evaluate({ &p, &p + 1 }, { &r, &r + 1 });
+		return r;
+	}
+
+	void sdfExpression(PointerRange<const Vec3> positions, PointerRange<Real> results)
+	{
+		program.evaluate(positions, results);
+	}
+}
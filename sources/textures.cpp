@@ -1,97 +1,350 @@
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "fractalNoise.h"
 #include "planets.h"
 
 #include <cage-core/imageAlgorithms.h>
 #include <cage-core/meshAlgorithms.h>
+#include <cage-core/tasks.h>
 
 namespace unnatural
 {
-	void terrainTile(Tile &tile);
+	void terrainTiles(PointerRange<Tile> tiles);
+	bool terrainHasClimate();
+	void terrainClimate(PointerRange<Tile> tiles);
+	Real meshTexelSize();
 
 	namespace
 	{
+		// fills uncovered texels within the radius (in chebyshev distance) of a covered texel by copying the record of the nearest covered texel
+		// the nearest covered texels are found by jump flooding
+		struct Dilation
+		{
+			PointerRange<uint8> coverage; // one byte per texel
+			PointerRange<uint8> data; // stride bytes per texel
+			const uint32 stride = 0;
+			const uint32 width = 0;
+			const uint32 height = 0;
+			const sint32 radius = 0;
+			std::vector<Vec2i> seeds, next; // nearest covered texel, or -1
+			sint32 step = 0;
+
+			static constexpr uint32 BandRows = 16;
+
+			Dilation(PointerRange<uint8> coverage, PointerRange<uint8> data, uint32 stride, uint32 width, uint32 height, uint32 radius) : coverage(coverage), data(data), stride(stride), width(width), height(height), radius(radius)
+			{
+				CAGE_ASSERT(coverage.size() == width * height);
+				CAGE_ASSERT(data.size() == width * height * stride);
+			}
+
+			uint32 bands() const { return (height + BandRows - 1) / BandRows; }
+
+			static sint64 distance(const Vec2i &a, const Vec2i &b)
+			{
+				// chebyshev distance determines the coverage, euclidean distance breaks ties
+				const sint64 dx = a[0] - b[0], dy = a[1] - b[1];
+				const sint64 adx = dx < 0 ? -dx : dx, ady = dy < 0 ? -dy : dy;
+				return (adx > ady ? adx : ady) * (sint64(1) << 32) + dx * dx + dy * dy;
+			}
+
+			void initEntry(uint32 band)
+			{
+				const uint32 y1 = min((band + 1) * BandRows, height);
+				for (uint32 y = band * BandRows; y < y1; y++)
+					for (uint32 x = 0; x < width; x++)
+						seeds[y * width + x] = coverage[y * width + x] ? Vec2i(x, y) : Vec2i(-1);
+			}
+
+			void floodEntry(uint32 band)
+			{
+				const uint32 y1 = min((band + 1) * BandRows, height);
+				for (uint32 y = band * BandRows; y < y1; y++)
+				{
+					for (uint32 x = 0; x < width; x++)
+					{
+						const Vec2i p = Vec2i(x, y);
+						Vec2i best = seeds[y * width + x];
+						sint64 bestDist = best[0] < 0 ? std::numeric_limits<sint64>::max() : distance(best, p);
+						for (sint32 j = -1; j < 2; j++)
+						{
+							const sint32 yy = y + j * step;
+							if (yy < 0 || yy >= (sint32)height)
+								continue;
+							for (sint32 i = -1; i < 2; i++)
+							{
+								const sint32 xx = x + i * step;
+								if (xx < 0 || xx >= (sint32)width)
+									continue;
+								const Vec2i s = seeds[yy * width + xx];
+								if (s[0] < 0)
+									continue;
+								const sint64 d = distance(s, p);
+								if (d < bestDist)
+								{
+									best = s;
+									bestDist = d;
+								}
+							}
+						}
+						next[y * width + x] = best;
+					}
+				}
+			}
+
+			void fillEntry(uint32 band)
+			{
+				const uint32 y1 = min((band + 1) * BandRows, height);
+				for (uint32 y = band * BandRows; y < y1; y++)
+				{
+					for (uint32 x = 0; x < width; x++)
+					{
+						const Vec2i s = seeds[y * width + x];
+						if (s[0] < 0 || (s[0] == (sint32)x && s[1] == (sint32)y))
+							continue;
+						if (s[0] < (sint32)x - radius || s[0] > (sint32)x + radius || s[1] < (sint32)y - radius || s[1] > (sint32)y + radius)
+							continue;
+						const uint8 *src = data.data() + (s[1] * width + s[0]) * stride;
+						std::copy(src, src + stride, data.data() + (y * width + x) * stride);
+						coverage[y * width + x] = 1;
+					}
+				}
+			}
+
+			void flood(sint32 s)
+			{
+				step = s;
+				tasksRunBlocking("dilation flood", Delegate<void(uint32)>().bind<Dilation, &Dilation::floodEntry>(this), bands());
+				std::swap(seeds, next);
+			}
+
+			void run()
+			{
+				seeds.resize(width * height);
+				next.resize(width * height);
+				tasksRunBlocking("dilation init", Delegate<void(uint32)>().bind<Dilation, &Dilation::initEntry>(this), bands());
+				sint32 first = 1;
+				while (first * 2 <= radius)
+					first *= 2;
+				for (sint32 s = first; s > 0; s /= 2)
+					flood(s);
+				flood(1); // one extra pass corrects most of the jump flooding errors
+				tasksRunBlocking("dilation fill", Delegate<void(uint32)>().bind<Dilation, &Dilation::fillEntry>(this), bands());
+			}
+		};
+
 		template<bool Water>
 		struct Generator
 		{
 			const Holder<Mesh> &mesh;
 			Holder<Image> &albedo;
-			Holder<Image> &special;
-			Holder<Image> &heightMap;
+			Holder<Image> &pbr;
+			Holder<Image> &normal;
 			const uint32 width = 0;
 			const uint32 height = 0;
 
-			Generator(const Holder<Mesh> &mesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &special, Holder<Image> &heightMap) : mesh(mesh), albedo(albedo), special(special), heightMap(heightMap), width(width), height(height) {}
+			Generator(const Holder<Mesh> &mesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &pbr, Holder<Image> &normal) : mesh(mesh), albedo(albedo), pbr(pbr), normal(normal), width(width), height(height) {}
 
-			void pixel(const Vec2i &xy, const Vec3i &indices, const Vec3 &weights)
+			// texels are collected from the rasterization into a window, which is then colored in blocks in parallel
+			static constexpr uint32 BlockSize = 256;
+			static constexpr uint32 WindowBlocks = 256; // limits the memory of the window
+
+			struct Texel
+			{
+				Vec2i xy;
+				Vec3i indices;
+				Vec3 weights;
+			};
+			// the texels are stored with 8 bits per channel, which is the precision of the final images
+			static constexpr uint32 AlbedoChannels = Water ? 4 : 3;
+			static constexpr uint32 Stride = AlbedoChannels + 3; // albedo, roughness, metallic, height
+			using TexelResult = std::array<uint8, Stride>;
+			std::vector<Texel> texels;
+			std::vector<TexelResult> results;
+			std::vector<uint8> coverage; // one byte per texel
+			std::vector<uint8> data; // Stride bytes per texel
+
+			static uint8 quantize(Real v)
+			{
+				return numeric_cast<uint8>(saturate(v).value * 255 + 0.5f);
+			}
+
+			// climate evaluated at the mesh vertices and interpolated for each texel
+			// empty when the coloring mode has no climate
+			std::vector<Real> vertexTemperatures;
+			std::vector<Real> vertexPrecipitations;
+
+			static PointerRange<Tile> blockTiles(uint32 count)
 			{
-				Tile tile;
-				tile.position = mesh->positionAt(indices, weights);
-				tile.normal = mesh->normalAt(indices, weights);
-				if (Water)
+				thread_local std::vector<Tile> tiles;
+				tiles.resize(BlockSize);
+				return { tiles.data(), tiles.data() + count };
+			}
+
+			void climateEntry(uint32 index)
+			{
+				const SamplingFootprint footprint(meshTexelSize());
+				const auto positions = mesh->positions();
+				const uint32 offset = index * BlockSize;
+				const uint32 cnt = min(numeric_cast<uint32>(positions.size()) - offset, BlockSize);
+				const PointerRange<Tile> tiles = blockTiles(cnt);
+				for (uint32 i = 0; i < cnt; i++)
 				{
-					tile.meshPurpose = MeshPurposeEnum::Water;
-					terrainTile(tile);
-					albedo->set(xy, Vec4(tile.albedo, tile.opacity));
+					Tile &tile = tiles[i];
+					tile = Tile();
+					tile.position = positions[offset + i];
+					tile.meshPurpose = Water ? MeshPurposeEnum::Water : MeshPurposeEnum::Land;
 				}
-				else
+				terrainClimate(tiles);
+				for (uint32 i = 0; i < cnt; i++)
 				{
-					tile.meshPurpose = MeshPurposeEnum::Land;
-					terrainTile(tile);
-					albedo->set(xy, tile.albedo);
+					vertexTemperatures[offset + i] = tiles[i].temperature;
+					vertexPrecipitations[offset + i] = tiles[i].precipitation;
 				}
-				special->set(xy, Vec2(tile.roughness, tile.metallic));
-				heightMap->set(xy, tile.height);
 			}
 
-			void generate()
+			void vertexClimate()
+			{
+				if (!terrainHasClimate())
+					return;
+				const uint32 total = mesh->verticesCount();
+				vertexTemperatures.resize(total);
+				vertexPrecipitations.resize(total);
+				tasksRunBlocking("texture climate", Delegate<void(uint32)>().bind<Generator, &Generator::climateEntry>(this), (total + BlockSize - 1) / BlockSize);
+			}
+
+			void blockEntry(uint32 index)
+			{
+				const SamplingFootprint footprint(meshTexelSize());
+				const uint32 offset = index * BlockSize;
+				const uint32 cnt = min(numeric_cast<uint32>(texels.size()) - offset, BlockSize);
+				const PointerRange<Tile> tiles = blockTiles(cnt);
+				for (uint32 i = 0; i < cnt; i++)
+				{
+					const Texel &t = texels[offset + i];
+					Tile &tile = tiles[i];
+					tile = Tile();
+					tile.position = mesh->positionAt(t.indices, t.weights);
+					tile.normal = mesh->normalAt(t.indices, t.weights);
+					tile.meshPurpose = Water ? MeshPurposeEnum::Water : MeshPurposeEnum::Land;
+					if (!vertexTemperatures.empty())
+					{
+						tile.temperature = vertexTemperatures[t.indices[0]] * t.weights[0] + vertexTemperatures[t.indices[1]] * t.weights[1] + vertexTemperatures[t.indices[2]] * t.weights[2];
+						tile.precipitation = vertexPrecipitations[t.indices[0]] * t.weights[0] + vertexPrecipitations[t.indices[1]] * t.weights[1] + vertexPrecipitations[t.indices[2]] * t.weights[2];
+					}
+				}
+				terrainTiles(tiles);
+				for (uint32 i = 0; i < cnt; i++)
+				{
+					const Tile &tile = tiles[i];
+					TexelResult &r = results[offset + i];
+					for (uint32 c = 0; c < 3; c++)
+						r[c] = quantize(tile.albedo[c]);
+					if (Water)
+						r[3] = quantize(tile.opacity);
+					r[AlbedoChannels + 0] = quantize(tile.roughness);
+					r[AlbedoChannels + 1] = quantize(tile.metallic);
+					r[AlbedoChannels + 2] = quantize(tile.height);
+				}
+			}
+
+			void flush()
 			{
-				albedo = newImage();
-				if (Water)
+				if (texels.empty())
+					return;
+				results.resize(texels.size());
+				tasksRunBlocking("texture block", Delegate<void(uint32)>().bind<Generator, &Generator::blockEntry>(this), numeric_cast<uint32>((texels.size() + BlockSize - 1) / BlockSize));
+				// texels on edges shared by triangles may be rasterized multiple times, writing in the rasterization order keeps the last one
+				for (uint32 i = 0; i < texels.size(); i++)
 				{
-					albedo->initialize(width, height, 4, ImageFormatEnum::Float);
-					imageFill(+albedo, Vec4::Nan());
+					const uint32 t = texels[i].xy[1] * width + texels[i].xy[0];
+					std::copy(results[i].begin(), results[i].end(), data.data() + t * Stride);
+					coverage[t] = 1;
 				}
-				else
+				texels.clear();
+			}
+
+			void pixel(const Vec2i &xy, const Vec3i &indices, const Vec3 &weights)
+			{
+				texels.push_back({ xy, indices, weights });
+				if (texels.size() == BlockSize * WindowBlocks)
+					flush();
+			}
+
+			// the channels of each final image are gathered into a contiguous buffer, which is imported into the image as a whole
+			// one image at a time limits the temporary memory
+			Holder<Image> plane(uint32 first, uint32 channels) const
+			{
+				std::vector<uint8> buffer;
+				buffer.resize(width * height * channels);
+				const uint8 *src = data.data() + first;
+				uint8 *dst = buffer.data();
+				const uint32 total = width * height;
+				for (uint32 i = 0; i < total; i++)
 				{
-					albedo->initialize(width, height, 3, ImageFormatEnum::Float);
-					imageFill(+albedo, Vec3::Nan());
+					for (uint32 c = 0; c < channels; c++)
+						dst[c] = src[c];
+					src += Stride;
+					dst += channels;
 				}
-				special = newImage();
-				special->initialize(width, height, 2, ImageFormatEnum::Float);
-				imageFill(+special, Vec2::Nan());
-				heightMap = newImage();
-				heightMap->initialize(width, height, 1, ImageFormatEnum::Float);
-				imageFill(+heightMap, Real::Nan());
+				Holder<Image> img = newImage();
+				img->importRaw({ (const char *)buffer.data(), (const char *)buffer.data() + buffer.size() }, Vec2i(width, height), channels, ImageFormatEnum::U8);
+				return img;
+			}
+
+			// the gltf pbr and normal map encodings are done by cage, so that they stay identical to other assets
+			void output()
+			{
+				albedo = plane(0, AlbedoChannels);
+				pbr = plane(AlbedoChannels, 2); // roughness and metallic until encoded
+				normal = plane(AlbedoChannels + 2, 1); // height until encoded
+				imageConvertSpecialToGltfPbr(+pbr);
+				imageConvertHeigthToNormal(+normal, 1);
+			}
+
+			void generate()
+			{
+				coverage.resize(width * height);
+				data.resize(width * height * Stride);
 
 				{
+					texels.reserve(BlockSize * WindowBlocks);
+					vertexClimate();
 					MeshGenerateTextureConfig cfg;
 					cfg.width = width;
 					cfg.height = height;
 					cfg.generator.bind<Generator, &Generator::pixel>(this);
 					meshGenerateTexture(+mesh, cfg);
+					flush();
 				}
 
 				{
-					imageDilation(+albedo, 7, true);
-					imageDilation(+special, 7, true);
-					imageDilation(+heightMap, 7, true);
+					Dilation dilation(coverage, data, Stride, width, height, 7);
+					dilation.run();
 				}
 
-				imageConvert(+albedo, ImageFormatEnum::U8);
-				imageConvert(+special, ImageFormatEnum::U8);
-				imageConvert(+heightMap, ImageFormatEnum::U8);
+				output();
 			}
 		};
 	}
 
-	void generateTexturesLand(const Holder<Mesh> &renderMesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &special, Holder<Image> &heightMap)
+	uint64 texturesMemoryEstimate(uint32 width, uint32 height)
+	{
+		// texel records and coverage, jump flooding seeds, final images including their encoding
+		static constexpr uint64 BytesPerTexel = 8 + 1 + 16 + 14;
+		return uint64(width) * height * BytesPerTexel;
+	}
+
+	void generateTexturesLand(const Holder<Mesh> &renderMesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &pbr, Holder<Image> &normal)
 	{
-		Generator<false> gen(renderMesh, width, height, albedo, special, heightMap);
+		Generator<false> gen(renderMesh, width, height, albedo, pbr, normal);
 		gen.generate();
 	}
 
-	void generateTexturesWater(const Holder<Mesh> &renderMesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &special, Holder<Image> &heightMap)
+	void generateTexturesWater(const Holder<Mesh> &renderMesh, uint32 width, uint32 height, Holder<Image> &albedo, Holder<Image> &pbr, Holder<Image> &normal)
 	{
-		Generator<true> gen(renderMesh, width, height, albedo, special, heightMap);
+		Generator<true> gen(renderMesh, width, height, albedo, pbr, normal);
 		gen.generate();
 	}
 }
@@ -1,5 +1,6 @@
 #include <queue>
 
+#include "fractalNoise.h"
 #include "planets.h"
 
 #include <cage-core/config.h>
@@ -14,6 +15,7 @@
 namespace unnatural
 {
 	void terrainTile(Tile &tile);
+	Real meshTileSize();
 
 	namespace
 	{
@@ -247,6 +249,7 @@ namespace unnatural
 
 		const uint32 cnt = navMesh->verticesCount();
 		tiles.reserve(cnt);
+		const SamplingFootprint footprint(meshTileSize());
 
 		PropertyCounters elevations(-200, 600);
 		PropertyCounters<8> slopes(10, 45);
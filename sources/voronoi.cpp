@@ -1,18 +1,61 @@
-#include <algorithm> // std::sort
+#include <algorithm> // std::copy
+#include <atomic>
+#include <vector>
 
 #include "voronoi.h"
 
-#include <cage-core/geometry.h>
-#include <cage-core/memoryAlloca.h>
-
 namespace unnatural
 {
+	namespace
+	{
+		std::atomic<uint32> lastVoronoiId = 0;
+
+		// points of the 27 cells around the center cell, generated by the last query of one voronoi on this thread
+		// stored as structure of arrays, so that the distances are computed in simd lanes
+		struct CellsCache
+		{
+			std::vector<float> xs, ys, zs;
+			Vec3i cell;
+			uint32 id = 0;
+		};
+
+		// consecutive queries (eg. neighboring texels) usually fall into the same or an adjacent cell
+		// several slots allow interleaving queries to multiple voronois
+		constexpr uint32 CacheSlots = 8;
+		thread_local CellsCache cellsCaches[CacheSlots];
+		thread_local uint32 cellsCachesNext = 0;
+
+		static_assert(VoronoiResult::MaxPoints == 4);
+
+		// sorted four smallest distances and indices of their points
+		struct Nearest
+		{
+			float d[4] = { Real::Infinity().value, Real::Infinity().value, Real::Infinity().value, Real::Infinity().value };
+			uint32 i[4] = {};
+
+			// branch-free insertion network
+			void insert(float dist, uint32 index)
+			{
+				const bool l0 = dist < d[0], l1 = dist < d[1], l2 = dist < d[2], l3 = dist < d[3];
+				d[3] = l2 ? d[2] : l3 ? dist : d[3];
+				i[3] = l2 ? i[2] : l3 ? index : i[3];
+				d[2] = l1 ? d[1] : l2 ? dist : d[2];
+				i[2] = l1 ? i[1] : l2 ? index : i[2];
+				d[1] = l0 ? d[0] : l1 ? dist : d[1];
+				i[1] = l0 ? i[0] : l1 ? index : i[1];
+				d[0] = l0 ? dist : d[0];
+				i[0] = l0 ? index : i[0];
+			}
+		};
+	}
+
 	class VoronoiImpl : public Voronoi
 	{
 	public:
 		const VoronoiCreateConfig cfg;
 		const Vec3i seedHashes;
 		const Real frequency;
+		const uint32 id = ++lastVoronoiId;
 
 		VoronoiImpl(const VoronoiCreateConfig &cfg) : cfg(cfg), seedHashes(hash(cfg.seed), hash(hash(cfg.seed)), hash(hash(hash(cfg.seed)))), frequency(1 / cfg.cellSize) {}
 
@@ -25,56 +68,118 @@ namespace unnatural
 
 		Vec3 genPoint(const Vec3i &s) { return Vec3(s % 65536) / 65535; }
 
-		struct Point
-		{
-			Vec3 p; // point
-			Real d; // distance
-		};
-
-		void genCell(Point *&out, const Vec3i &cell)
+		void genCell(CellsCache &out, uint32 offset, const Vec3i &cell)
 		{
 			Vec3i s = mix(cell);
 			for (uint32 i = 0; i < cfg.pointsPerCell; i++)
 			{
 				s = mix(s);
-				(out++)->p = (genPoint(s) + Vec3(cell)) * cfg.cellSize;
+				const Vec3 p = (genPoint(s) + Vec3(cell)) * cfg.cellSize;
+				out.xs[offset + i] = p[0].value;
+				out.ys[offset + i] = p[1].value;
+				out.zs[offset + i] = p[2].value;
 			}
 		}
 
-		VoronoiResult evaluate(const Vec3 &position, const Vec3 &normal)
+		// returns points of all cells neighboring the cell, reusing the cells generated by the previous query
+		const CellsCache &cells(const Vec3i &cell)
 		{
-			const uint32 totalPoints = cfg.pointsPerCell * 27;
-			Point *const pointsMem = (Point *)CAGE_ALLOCA(totalPoints * sizeof(Point));
-
-			{ // generate all points (including neighboring cells)
-				Point *gen = pointsMem;
-				const Vec3i cell = Vec3i(position * frequency);
-				for (sint32 z = -1; z < 2; z++)
-					for (sint32 y = -1; y < 2; y++)
-						for (sint32 x = -1; x < 2; x++)
-							genCell(gen, cell + Vec3i(x, y, z));
-				CAGE_ASSERT(gen == pointsMem + totalPoints);
+			CellsCache *c = nullptr;
+			for (CellsCache &it : cellsCaches)
+				if (it.id == id)
+					c = &it;
+			if (!c)
+			{
+				c = &cellsCaches[cellsCachesNext++ % CacheSlots];
+				c->id = 0;
 			}
 
-			const PointerRange<Point> points = { pointsMem, pointsMem + totalPoints };
-
-			if (valid(normal))
-			{ // project all points into the plane
-				const Plane pln = Plane(position, normal);
-				for (Point &p : points)
-					p.p = closestPoint(pln, p.p);
+			const Vec3i delta = cell - c->cell;
+			if (c->id == id && delta == Vec3i())
+				return *c;
+
+			const uint32 ppc = cfg.pointsPerCell;
+			const bool reuse = c->id == id;
+			thread_local CellsCache next;
+			next.xs.resize(ppc * 27);
+			next.ys.resize(ppc * 27);
+			next.zs.resize(ppc * 27);
+			uint32 gen = 0;
+			for (sint32 z = -1; z < 2; z++)
+			{
+				for (sint32 y = -1; y < 2; y++)
+				{
+					for (sint32 x = -1; x < 2; x++)
+					{
+						const Vec3i o = Vec3i(x, y, z) + delta; // offset in the previous query
+						if (reuse && o[0] >= -1 && o[0] <= 1 && o[1] >= -1 && o[1] <= 1 && o[2] >= -1 && o[2] <= 1)
+						{
+							const uint32 src = ((o[2] + 1) * 9 + (o[1] + 1) * 3 + (o[0] + 1)) * ppc;
+							std::copy(c->xs.begin() + src, c->xs.begin() + src + ppc, next.xs.begin() + gen);
+							std::copy(c->ys.begin() + src, c->ys.begin() + src + ppc, next.ys.begin() + gen);
+							std::copy(c->zs.begin() + src, c->zs.begin() + src + ppc, next.zs.begin() + gen);
+						}
+						else
+							genCell(next, gen, cell + Vec3i(x, y, z));
+						gen += ppc;
+					}
+				}
 			}
+			CAGE_ASSERT(gen == next.xs.size());
+			std::swap(c->xs, next.xs);
+			std::swap(c->ys, next.ys);
+			std::swap(c->zs, next.zs);
+			c->cell = cell;
+			c->id = id;
+			return *c;
+		}
 
-			{ // sort all points by distance
-				for (Point &p : points)
-					p.d = distanceSquared(p.p, position);
-				std::partial_sort(points.begin(), points.begin() + VoronoiResult::MaxPoints, points.end(), [&](const Point &a, const Point &b) { return a.d < b.d; });
+		VoronoiResult evaluate(const Vec3 &position, const Vec3 &normal)
+		{
+			const CellsCache &c = cells(Vec3i(position * frequency));
+			const uint32 total = numeric_cast<uint32>(c.xs.size());
+			CAGE_ASSERT(total == cfg.pointsPerCell * 27);
+			const float *xs = c.xs.data(), *ys = c.ys.data(), *zs = c.zs.data();
+			const float px = position[0].value, py = position[1].value, pz = position[2].value;
+
+			// squared distances of the points projected into the plane (if any), independent lanes
+			thread_local std::vector<float> distances;
+			distances.resize(total);
+			float *ds = distances.data();
+			const bool project = valid(normal);
+			if (project)
+			{
+				const float nx = normal[0].value, ny = normal[1].value, nz = normal[2].value;
+				for (uint32 i = 0; i < total; i++)
+				{
+					const float qx = xs[i] - px, qy = ys[i] - py, qz = zs[i] - pz;
+					const float h = qx * nx + qy * ny + qz * nz;
+					const float ex = qx - nx * h, ey = qy - ny * h, ez = qz - nz * h;
+					ds[i] = ex * ex + ey * ey + ez * ez;
+				}
 			}
+			else
+			{
+				for (uint32 i = 0; i < total; i++)
+				{
+					const float qx = xs[i] - px, qy = ys[i] - py, qz = zs[i] - pz;
+					ds[i] = qx * qx + qy * qy + qz * qz;
+				}
+			}
+
+			Nearest nearest;
+			for (uint32 i = 0; i < total; i++)
+				nearest.insert(ds[i], i);
 
 			VoronoiResult res;
-			CAGE_ASSERT(VoronoiResult::MaxPoints <= points.size());
-			for (uint32 i = 0; i < VoronoiResult::MaxPoints; i++)
-				res.points[i] = points[i].p;
+			for (uint32 k = 0; k < VoronoiResult::MaxPoints; k++)
+			{
+				const uint32 i = nearest.i[k];
+				Vec3 p = Vec3(xs[i], ys[i], zs[i]);
+				if (project)
+					p -= normal * dot(normal, p - position);
+				res.points[k] = p;
+			}
 			return res;
 		}
 	};
@@ -85,6 +190,16 @@ namespace unnatural
 		return impl->evaluate(position, normal);
 	}
 
+	void Voronoi::evaluate(PointerRange<const Vec3> positions, PointerRange<const Vec3> normals, PointerRange<VoronoiResult> results)
+	{
+		VoronoiImpl *impl = (VoronoiImpl *)this;
+		CAGE_ASSERT(positions.size() == results.size());
+		CAGE_ASSERT(normals.empty() || normals.size() == positions.size());
+		const uint32 cnt = numeric_cast<uint32>(positions.size());
+		for (uint32 i = 0; i < cnt; i++)
+			results[i] = impl->evaluate(positions[i], normals.empty() ? Vec3::Nan() : normals[i]);
+	}
+
 	Holder<Voronoi> newVoronoi(const VoronoiCreateConfig &cfg)
 	{
 		return systemMemory().createImpl<Voronoi, VoronoiImpl>(cfg);
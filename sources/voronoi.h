@@ -15,6 +15,9 @@ namespace unnatural
 	{
 	public:
 		VoronoiResult evaluate(const Vec3 &position, const Vec3 &normal);
+
+		// normals may be empty, in which case the points are not projected
+		void evaluate(PointerRange<const Vec3> positions, PointerRange<const Vec3> normals, PointerRange<VoronoiResult> results);
 	};
 
 	struct VoronoiCreateConfig